@@ -0,0 +1,207 @@
+#pragma once
+#ifndef XERXES_ANALYTICAL_MEMORY_HH
+#define XERXES_ANALYTICAL_MEMORY_HH
+
+#include "memory_endpoint.hh"
+#include "utils.hh"
+
+#include <map>
+
+namespace xerxes {
+// Timings are in ticks. The defaults follow DRAMsim3's
+// DDR4_8Gb_x8_3200.ini at tick_per_clock = 1 (CL = tRCD = tRP = 22, BL8,
+// 16 banks in one channel, 8KB rows, open page).
+class AnalyticalMemoryConfig {
+  public:
+    Tick process_time = 1;
+    Addr start = 0;
+    size_t capacity = 1 << 30;
+    double wr_ratio = 0.5;
+    // Device addresses are mapped as row:channel:bank:column, with
+    // `row_lines` 64B lines per row, as DRAMsim3's "rochrababgco".
+    size_t channels = 1;
+    size_t banks = 16;
+    size_t row_lines = 128;
+    Tick cas_latency = 22;
+    Tick activate_latency = 22;
+    Tick precharge_latency = 22;
+    // Data bus time of a line.
+    Tick burst_time = 4;
+    // Data bus bubble between a read and a write next to each other.
+    Tick rw_turnaround = 0;
+};
+} // namespace xerxes
+
+TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::AnalyticalMemoryConfig,
+                                       process_time, start, capacity, wr_ratio,
+                                       channels, banks, row_lines, cas_latency,
+                                       activate_latency, precharge_latency,
+                                       burst_time, rw_turnaround);
+
+namespace xerxes {
+// A memory without a cycle-level DRAM model. Each bank keeps its row open
+// and serves requests in arrival order: a row hit takes CL, a closed bank
+// tRCD + CL, and a row conflict tRP + tRCD + CL. The data then takes the
+// first free slot of its channel's bus. It is much faster than
+// DRAMsim3Interface (no memory is ticked), at the cost of accuracy under
+// load, e.g., refresh, bank group timings and request reordering are not
+// modeled.
+class AnalyticalMemory : public MemoryEndpoint {
+    static constexpr size_t LINE = 64;
+    static constexpr Addr NO_ROW = (Addr)-1;
+
+    // A reserved burst of a data bus, by its start.
+    struct Slot {
+        Tick end;
+        bool write;
+    };
+
+    Tick process_time;
+    size_t channel_num;
+    size_t bank_num;
+    size_t row_lines;
+    Tick cas;
+    Tick activate;
+    Tick precharge;
+    Tick burst;
+    Tick turnaround;
+
+    // Open row of each bank, and the tick the bank is free.
+    std::vector<Addr> open_rows;
+    std::vector<Tick> bank_free;
+    std::vector<std::map<Tick, Slot>> buses;
+
+    // Statistics.
+    double reads = 0;
+    double writes = 0;
+    double row_hits = 0;
+    double row_conflicts = 0;
+    double turnarounds = 0;
+    double queuing = 0;
+    Tick last_done = 0;
+
+    // Reserve the first slot of a bus at or after `ready` for a burst, with
+    // a turnaround bubble next to the slots of the other direction.
+    Tick reserve_bus(std::map<Tick, Slot> &bus, Tick ready, bool write,
+                     Tick arrive) {
+        // Requests arrive in order, so only the last slot ending before
+        // the arrival is still a neighbour.
+        while (bus.size() > 1 && std::next(bus.begin())->second.end <= arrive)
+            bus.erase(bus.begin());
+        auto next = bus.upper_bound(ready);
+        auto prev = next == bus.begin() ? bus.end() : std::prev(next);
+        auto start = ready;
+        bool bubble = false;
+        while (true) {
+            if (prev != bus.end()) {
+                auto gap = prev->second.write != write ? turnaround : 0;
+                bubble = gap > 0 && prev->second.end + gap > start;
+                start = std::max(start, prev->second.end + gap);
+            }
+            if (next == bus.end())
+                break;
+            auto gap = next->second.write != write ? turnaround : 0;
+            if (start + burst + gap <= next->first)
+                break;
+            prev = next++;
+        }
+        turnarounds += bubble;
+        bus[start] = {start + burst, write};
+        return start;
+    }
+
+    // Serve a request, returns the tick its data is transferred.
+    Tick serve(Packet &pkt) {
+        auto line = device_addr(pkt.addr) / LINE;
+        auto page = line / row_lines;
+        auto bank_i = page % (bank_num * channel_num);
+        auto channel = bank_i / bank_num;
+        auto row = page / (bank_num * channel_num);
+
+        Tick open = 0;
+        if (open_rows[bank_i] == NO_ROW) {
+            open = activate;
+        } else if (open_rows[bank_i] != row) {
+            open = precharge + activate;
+            row_conflicts += 1;
+        } else {
+            row_hits += 1;
+        }
+        open_rows[bank_i] = row;
+
+        // The bank is busy opening the row and bursting the line out.
+        auto bank_start = std::max(pkt.arrive, bank_free[bank_i]);
+        bank_free[bank_i] = bank_start + open + burst;
+        auto ready = bank_start + open + cas;
+        auto bus_start =
+            reserve_bus(buses[channel], ready, pkt.is_write(), pkt.arrive);
+        auto wait = (bank_start - pkt.arrive) + (bus_start - ready);
+        queuing += wait;
+        auto done = bus_start + burst;
+        pkt.delta_stat(DRAM_INTERFACE_QUEUING_DELAY, (double)wait);
+        pkt.delta_stat(DRAM_TIME, (double)(done - pkt.arrive - wait));
+        return done;
+    }
+
+  public:
+    AnalyticalMemory(Simulation *sim, const AnalyticalMemoryConfig &config,
+                     std::string name = "AnalyticalMemory")
+        : MemoryEndpoint(sim, config.start, config.capacity, config.wr_ratio,
+                         name),
+          process_time(config.process_time), channel_num(config.channels),
+          bank_num(config.banks), row_lines(config.row_lines),
+          cas(config.cas_latency), activate(config.activate_latency),
+          precharge(config.precharge_latency), burst(config.burst_time),
+          turnaround(config.rw_turnaround),
+          open_rows(config.channels * config.banks, NO_ROW),
+          bank_free(config.channels * config.banks, 0),
+          buses(config.channels) {
+        ASSERT(channel_num > 0 && bank_num > 0 && row_lines > 0,
+               name + ": channels, banks and row_lines should be positive");
+        ASSERT(burst > 0, name + ": burst_time should be positive");
+    }
+
+    void transit() override {
+        auto pkt = receive_pkt();
+        while (pkt.type != PacketType::PKT_TYPE_NUM) {
+            if (pkt.dst == self) {
+                pkt.delta_stat(DEVICE_PROCESS_TIME, (double)(process_time));
+                pkt.arrive += process_time;
+                pkt.arrive = serve(pkt);
+                last_done = std::max(last_done, pkt.arrive);
+                if (pkt.is_write()) {
+                    writes += 1;
+                    pkt.payload = 0;
+                } else {
+                    reads += 1;
+                    pkt.payload = 64;
+                }
+                std::swap(pkt.src, pkt.dst);
+                pkt.is_rsp = true;
+                send_pkt(pkt);
+            } else {
+                send_pkt(pkt);
+            }
+            pkt = receive_pkt();
+        }
+    }
+
+    void log_stats(std::ostream &os) override {
+        auto count = reads + writes;
+        os << name() << " stats: " << std::endl;
+        os << " * Reads/writes: " << reads << "/" << writes << std::endl;
+        os << " * Row hits/conflicts: " << row_hits << "/" << row_conflicts
+           << std::endl;
+        os << " * Read/write turnarounds: " << turnarounds << std::endl;
+        os << " * Average queuing (ns): " << (count > 0 ? queuing / count : 0)
+           << std::endl;
+        os << " * Data bus utilization: "
+           << (last_done > 0
+                   ? count * burst / (double)(last_done * channel_num)
+                   : 0)
+           << std::endl;
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_ANALYTICAL_MEMORY_HH
@@ -5,7 +5,9 @@
 #include "device.hh"
 
 #include <algorithm>
+#include <cmath>
 #include <map>
+#include <random>
 
 namespace xerxes {
 class DuplexBusConfig {
@@ -16,12 +18,17 @@ class DuplexBusConfig {
     size_t width = 32;
     Tick framing_time = 20;
     size_t frame_size = 256;
+    // Bit error rate of the link, 0 means an error-free link.
+    double bit_error_rate = 0;
+    // Time from a corrupted frame to the start of its replay (NAK round trip).
+    Tick replay_time = 40;
 };
 } // namespace xerxes
 
 TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::DuplexBusConfig, is_full,
                                        half_rev_time, delay_per_T, width,
-                                       framing_time, frame_size);
+                                       framing_time, frame_size,
+                                       bit_error_rate, replay_time);
 
 namespace xerxes {
 // 1-to-1 bus device, used for transferring packets between devices and add
@@ -46,9 +53,31 @@ class DuplexBus : public Device {
     size_t width;
     size_t frame_size;
     Tick framing_time;
+    // Link-layer retry: probability that a frame fails the CRC check.
+    double frame_err_prob;
+    Tick replay_time;
+    std::mt19937_64 gen;
+    std::bernoulli_distribution corrupt;
 
     std::map<std::string, double> stats;
 
+    // Sample the link-layer replay time of a packet with `frame` frames.
+    // Each corrupted frame costs a replay round trip and the retransmission
+    // of itself and all frames after it (go-back-N).
+    Tick retry_time(size_t frame, Tick frame_delay) {
+        if (frame_err_prob <= 0)
+            return 0;
+        Tick retry = 0;
+        for (size_t i = 0; i < frame; ++i) {
+            while (corrupt(gen)) {
+                retry += replay_time + (frame - i) * frame_delay;
+                stats["Replay count"] += 1;
+            }
+        }
+        stats["Replay time"] += retry;
+        return retry;
+    }
+
     Tick reverse_time(TopoID from, TopoID to, Tick arrive, bool is_write) {
         if (is_full)
             return 0;
@@ -90,11 +119,21 @@ class DuplexBus : public Device {
         : Device(sim, name), is_full(config.is_full),
           half_rev_time(config.half_rev_time), delay_per_T(config.delay_per_T),
           width(config.width / 8), // Input as bit-width, convert to bytes.
-          frame_size(config.frame_size), framing_time(config.framing_time) {
+          frame_size(config.frame_size), framing_time(config.framing_time),
+          frame_err_prob(
+              1 - std::pow(1 - config.bit_error_rate, frame_size * 8.0)),
+          replay_time(config.replay_time), gen(self),
+          corrupt(frame_err_prob) {
+        ASSERT(frame_err_prob < 1,
+               this->name() + ": bit error rate is too high");
         stats.insert(std::make_pair("Transfered_bytes", 0));
         stats.insert(std::make_pair("Transfered_payloads", 0));
         stats.insert(std::make_pair("Direction reverse count", 0));
         stats.insert(std::make_pair("Sent sub-packet count", 0));
+        if (frame_err_prob > 0) {
+            stats.insert(std::make_pair("Replay count", 0));
+            stats.insert(std::make_pair("Replay time", 0));
+        }
     }
 
     void transit() override {
@@ -114,16 +153,21 @@ class DuplexBus : public Device {
         // absolute ceil (frames have some overheads)
         size_t frame = (pkt.payload + frame_size) / frame_size;
         auto &route = get_or_init_route(pkt.from, to->id());
+        auto frame_delay = ((frame_size + width - 1) / width) * delay_per_T;
         auto delay = ((frame * frame_size + width - 1) / width) * delay_per_T;
+        // Replays hold the link, so later packets in this direction wait.
+        auto retry = retry_time(frame, frame_delay);
         auto rev = reverse_time(pkt.from, to->id(), pkt.arrive, pkt.is_write());
         if (rev > 0) {
             auto finish_rev = route.timeline.transfer_time(pkt.arrive, rev);
             if (finish_rev > pkt.arrive)
                 pkt.arrive = finish_rev;
         }
-        auto transfer_time = route.timeline.transfer_time(pkt.arrive, delay);
-        route.occupy += delay;
-        route.last_occupy = std::max(route.last_occupy, pkt.arrive + delay);
+        auto transfer_time =
+            route.timeline.transfer_time(pkt.arrive, delay + retry);
+        route.occupy += delay + retry;
+        route.last_occupy =
+            std::max(route.last_occupy, pkt.arrive + delay + retry);
 
         pkt.delta_stat(BUS_QUEUE_DELAY, (double)(transfer_time - pkt.arrive));
         pkt.delta_stat(FRAMING_TIME, (double)framing_time);
@@ -132,8 +176,10 @@ class DuplexBus : public Device {
             << "]: " << transfer_time << " - " << pkt.arrive << " = "
             << (double)(transfer_time - pkt.arrive) << std::endl;
         pkt.delta_stat(BUS_TIME, (double)delay);
+        if (retry > 0)
+            pkt.delta_stat(LINK_RETRY_DELAY, (double)retry);
 
-        pkt.arrive = transfer_time + delay;
+        pkt.arrive = transfer_time + delay + retry;
         pkt.arrive +=
             framing_time; // Donot include framing time in routing time
 
@@ -145,6 +191,15 @@ class DuplexBus : public Device {
         send_pkt(pkt);
     }
 
+    // Start of the first idle window, at or after tick, on the link from
+    // `from` to `to` that fits a packet of `payload` bytes. Nothing is
+    // reserved.
+    Tick idle_window(TopoID from, TopoID to, Tick tick, size_t payload) {
+        size_t frame = (payload + frame_size) / frame_size;
+        auto delay = ((frame * frame_size + width - 1) / width) * delay_per_T;
+        return get_or_init_route(from, to).timeline.next_free(tick, delay);
+    }
+
     void log_stats(std::ostream &os) override {
         os << name() << " stats: " << std::endl;
         os << "Frame size: " << frame_size << " bytes" << std::endl;
@@ -1,3 +1,25 @@
+def toml_value(value):
+    if type(value) == bool:
+        return str(value).lower()
+    elif type(value) == str:
+        return f"\"{value}\""
+    elif type(value) == list:
+        return "[" + ", ".join(toml_value(v) for v in value) + "]"
+    elif type(value) == dict:
+        return "{ " + ", ".join(f"{k} = {toml_value(v)}" for k, v in value.items()) + " }"
+    else:
+        return f"{value}"
+
+def hdm_decoder(base, size, targets, granularity=256, hash="none"):
+    """An HDM decoder interleaving [base, base + size) over the target memories."""
+    return {
+        "base": base,
+        "size": size,
+        "granularity": granularity,
+        "hash": hash,
+        "targets": [t.name for t in targets],
+    }
+
 class Device:
     def __init__(self, name="Device"):
         self.typename = "Device"
@@ -11,12 +33,7 @@ class Device:
         res = ""
         res += f"[{self.name}]\n"
         for key, value in self.params.items():
-            if type(value) == bool:
-                res += f"{key} = {str(value).lower()}\n"
-            elif type(value) == str:
-                res += f"{key} = \"{value}\"\n"
-            else:
-                res += f"{key} = {value}\n"
+            res += f"{key} = {toml_value(value)}\n"
         return res
     
     def __setattr__(self, name, value):
@@ -37,7 +54,14 @@ class Requester(Device):
         self.name = name
         self.params = {
             "q_capacity": 32,
+            "l1_capacity": 0,
+            "l1_assoc": 8,
+            "l1_delay": 4,
+            "l2_capacity": 0,
+            "l2_assoc": 8,
+            "l2_delay": 8,
             "cache_capacity": 8192,
+            "cache_assoc": 16,
             "cache_delay": 12,
             "issue_delay": 0,
             "coherent": False,
@@ -48,6 +72,39 @@ class Requester(Device):
             "hot_req_ratio": 0.5,
             "hot_region_ratio": 0.5,
             "trace_file": "",
+            "trace_format": "auto",
+            "decoders": [],
+            "seed": 1,
+            "synthetic": {
+                "zipf_theta": 0.99,
+                "stream_num": 1,
+                "stride": 64,
+                "chase_footprint": 1 << 24,
+                "phase_length": 0,
+                "phase_wr_ratios": [],
+                "mix_types": [],
+                "mix_weights": [],
+            },
+            "load": {
+                "mode": "closed",
+                "rate": 1.0,
+                "max_outstanding": 0,
+                "sweep_rates": [],
+                "warmup": 10000,
+                "window": 100000,
+            },
+            "prefetch": {
+                "type": "none",
+                "degree": 1,
+                "distance": 1,
+                "table_size": 16,
+            },
+            "mrc_sample_rate": 0.0,
+            "cores": 1,
+            "rob_size": 0,
+            "mshr_size": 0,
+            "inst_gap": 0,
+            "inst_rate": 4.0,
         }
 
 class DuplexBus(Device):
@@ -61,6 +118,8 @@ class DuplexBus(Device):
             "width": 32,
             "framing_time": 20,
             "frame_size": 256,
+            "bit_error_rate": 0.0,
+            "replay_time": 40,
         }
 
 class DRAMsim3Interface(Device):
@@ -75,6 +134,34 @@ class DRAMsim3Interface(Device):
             "wr_ratio": 0.5,
             "config_file": "DRAMsim3/configs/DDR4_8Gb_x8_3200.ini",
             "output_dir": "output",
+            "buffer_capacity": 0,
+            "buffer_assoc": 16,
+            "buffer_delay": 4,
+            "prefetch": {
+                "type": "none",
+                "degree": 1,
+                "distance": 1,
+                "table_size": 16,
+            },
+        }
+
+class AnalyticalMemory(Device):
+    def __init__(self, name="AnalyticalMemory"):
+        self.typename = "AnalyticalMemory"
+        self.name = name
+        self.params = {
+            "process_time": 40,
+            "start": 0,
+            "capacity": 1 << 30,
+            "wr_ratio": 0.5,
+            "channels": 1,
+            "banks": 16,
+            "row_lines": 128,
+            "cas_latency": 22,
+            "activate_latency": 22,
+            "precharge_latency": 22,
+            "burst_time": 4,
+            "rw_turnaround": 0,
         }
 
 class Snoop(Device):
@@ -87,6 +174,15 @@ class Snoop(Device):
             "max_burst_inv": 8,
             "ranges": [[0, 1 << 30]],
             "eviction": "LRU",
+            "multi_sharer": False,
+            "region_size": 64,
+            "slices": 1,
+            "slice_hash": "mod",
+            "slice_delay": [],
+            "wait_write_back": False,
+            "set_watermark": 0.0,
+            "global_watermark": 0.0,
+            "mrc_sample_rate": 0.0,
         }
 
 class Switch(Device):
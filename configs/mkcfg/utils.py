@@ -2,6 +2,7 @@ class Config:
     def __init__(self, args=None):
         self.max_clock = 3000000
         self.clock_granu = 1
+        self.threads = 1
         self.log_level = "INFO"
         self.log_name = "output/default.csv"
         self.devices = {}
@@ -13,6 +14,7 @@ class Config:
     def fill_parser(parser):
         parser.add_argument("--max_clock", type=int, help="Maximum clock")
         parser.add_argument("--clock_granu", type=int, help="Clock granularity")
+        parser.add_argument("--threads", type=int, help="Threads clocking the memories, 0 for all hardware threads")
         parser.add_argument("--log_level", type=str, help="Log level")
         parser.add_argument("--log_name", type=str, help="Log name")
 
@@ -21,6 +23,8 @@ class Config:
             self.max_clock = args.max_clock
         if args.clock_granu is not None:
             self.clock_granu = args.clock_granu
+        if args.threads is not None:
+            self.threads = args.threads
         if args.log_level is not None:
             self.log_level = args.log_level
         if args.log_name is not None:
@@ -40,6 +44,7 @@ class Config:
         res = ""
         res += f"max_clock = {self.max_clock}\n"
         res += f"clock_granu = {self.clock_granu}\n"
+        res += f"threads = {self.threads}\n"
         res += f"log_level = \"{self.log_level}\"\n"
         res += f"log_name = \"{self.log_name}\"\n"
 
@@ -0,0 +1,97 @@
+import argparse
+
+from mkcfg.devices import *
+from mkcfg.utils import *
+
+parser = argparse.ArgumentParser(description="Generate a configuration file for a synthetic workload")
+parser.add_argument("--cfgname", type=str, help="Config file name")
+parser.add_argument("--outputdir", type=str, default="synthetic", help="Xerxes output (sub)directory")
+parser.add_argument("--workload", type=str, default="zipf", help="stream, random, hotcold, zipf, strided, chase or mix")
+parser.add_argument("--count", type=int, default=20000, help="Request count")
+parser.add_argument("--seed", type=int, default=1, help="Generator seed, 0 for a random one")
+parser.add_argument("--ratio", type=float, default=0.0, help="Write ratio of the memories")
+parser.add_argument("--theta", type=float, default=0.99, help="Zipfian skew")
+parser.add_argument("--streams", type=int, default=4, help="Strided streams per memory")
+parser.add_argument("--stride", type=int, default=256, help="Stride in bytes")
+parser.add_argument("--footprint", type=int, default=1 << 24, help="Pointer chase footprint per memory in bytes")
+parser.add_argument("--phase_len", type=int, default=0, help="Requests per read/write phase, 0 disables phases")
+parser.add_argument("--phase_ratios", type=str, default="0,1", help="Write ratio of each phase, comma separated")
+parser.add_argument("--mix", type=str, default="zipf:0.5,strided:0.5", help="Mixed workloads, as type:weight, comma separated")
+parser.add_argument("--load", type=str, default="closed", help="closed, constant or poisson injection")
+parser.add_argument("--rate", type=float, default=1.0, help="Injection rate in GB/s")
+parser.add_argument("--max_outstanding", type=int, default=0, help="Outstanding requests of open-loop injection, 0 for no limit")
+parser.add_argument("--sweep", type=str, default="", help="Offered loads to sweep in GB/s, comma separated")
+parser.add_argument("--warmup", type=int, default=10000, help="Warmup of each sweep step in ns")
+parser.add_argument("--window", type=int, default=100000, help="Measurement window of each sweep step in ns")
+parser.add_argument("--coherent", action="store_true", help="Issue coherent requests through the host cache")
+parser.add_argument("--prefetch", type=str, default="none", help="Host prefetcher: none, next_line, stride or stream")
+parser.add_argument("--pf_degree", type=int, default=1, help="Prefetch degree")
+parser.add_argument("--pf_distance", type=int, default=1, help="Prefetch distance")
+parser.add_argument("--backend", type=str, default="dramsim3", choices=["dramsim3", "analytical"], help="Memory model")
+parser.add_argument("--rob", type=int, default=0, help="ROB size, 0 disables the core model")
+Config.fill_parser(parser)
+args = parser.parse_args()
+cfg = Config(args)
+
+host = Requester(name="Host")
+host.interleave_type = args.workload
+host.interleave_param = args.count
+host.block_size = 64
+host.seed = args.seed
+host.rob_size = args.rob
+host.coherent = args.coherent
+host.prefetch = {
+    "type": args.prefetch,
+    "degree": args.pf_degree,
+    "distance": args.pf_distance,
+    "table_size": 16,
+}
+mix = [part.split(":") for part in args.mix.split(",")]
+host.synthetic = {
+    "zipf_theta": args.theta,
+    "stream_num": args.streams,
+    "stride": args.stride,
+    "chase_footprint": args.footprint,
+    "phase_length": args.phase_len,
+    "phase_wr_ratios": [float(r) for r in args.phase_ratios.split(",")],
+    "mix_types": [t for t, _ in mix],
+    "mix_weights": [float(w) for _, w in mix],
+}
+host.load = {
+    "mode": args.load,
+    "rate": args.rate,
+    "max_outstanding": args.max_outstanding,
+    "sweep_rates": [float(r) for r in args.sweep.split(",") if r != ""],
+    "warmup": args.warmup,
+    "window": args.window,
+}
+mems = []
+for i in range(4):
+    if args.backend == "analytical":
+        mem = AnalyticalMemory(name=f"Mem-{i}")
+    else:
+        mem = DRAMsim3Interface(name=f"Mem-{i}")
+    mem.start = i << 30
+    mem.wr_ratio = args.ratio
+    mems.append(mem)
+bus = DuplexBus(name="Bus")
+bus.width = 64
+bus.frame_size = 64
+switch = Switch(name="OracleSwitch")
+switch.delay = 0
+cfg.add_devices([host])
+cfg.add_devices(mems)
+cfg.add_devices([bus])
+cfg.add_devices([switch])
+cfg.connect(host, bus)
+cfg.connect(bus, switch)
+for mem in mems:
+    cfg.connect(switch, mem)
+
+cfg.log_name = f"output/{args.outputdir}/{args.workload}.csv"
+
+if args.cfgname is not None:
+    with open(args.cfgname, "w") as f:
+        f.write(f"{cfg}")
+else:
+    print(cfg)
@@ -8,6 +8,15 @@ parser.add_argument("--cfgname", type=str, help="Config file name")
 parser.add_argument("--outputdir", type=str, help="Xerxes output (sub)directory")
 parser.add_argument("--trace", type=str, help="Write ratio")
 parser.add_argument("--work", type=str, help="Work type")
+parser.add_argument("--cores", type=int, default=1, help="Cores per host")
+parser.add_argument("--rob", type=int, default=0, help="ROB size, 0 disables the core model")
+parser.add_argument("--mshr", type=int, default=0, help="MSHRs per core")
+parser.add_argument("--inst_gap", type=int, default=0, help="Instructions between trace records")
+parser.add_argument("--interleave_gran", type=int, default=0, help="HDM interleave granularity over all memories, 0 to send to each memory in turn")
+parser.add_argument("--dev_buffer", type=int, default=0, help="Device-side buffer lines per memory, 0 disables")
+parser.add_argument("--dev_prefetch", type=str, default="none", help="Device-side prefetcher: none, next_line, stride or stream")
+parser.add_argument("--dev_pf_degree", type=int, default=1, help="Device-side prefetch degree")
+parser.add_argument("--interleave_hash", type=str, default="none", help="HDM interleave hash (none or xor)")
 Config.fill_parser(parser)
 args = parser.parse_args()
 cfg = Config(args)
@@ -152,6 +161,22 @@ elif args.work in ["chain", "ring", "tree", "spineleaf", "full"]:
                 cfg.connect(switches[i], bus)
                 cfg.connect(bus, switches[j])
 
+mems = [dev for dev in cfg.devices.values() if dev.typename == "DRAMsim3Interface"]
+# Per-memory share of the interleaved window.
+share = min([mem.capacity for mem in mems] + [1 << 36])
+for mem in mems:
+    mem.buffer_capacity = args.dev_buffer
+    mem.prefetch = {"type": args.dev_prefetch, "degree": args.dev_pf_degree, "distance": 1, "table_size": 16}
+
+for dev in cfg.devices.values():
+    if dev.typename == "Requester":
+        dev.cores = args.cores
+        dev.rob_size = args.rob
+        dev.mshr_size = args.mshr
+        dev.inst_gap = args.inst_gap
+        if args.interleave_gran > 0:
+            dev.decoders = [hdm_decoder(0, share * len(mems), mems, args.interleave_gran, args.interleave_hash)]
+
 cfg.log_name = f"output/{args.outputdir}/{args.trace}.csv"
 if args.cfgname is not None:
     with open(args.cfgname, "w") as f:
@@ -8,12 +8,25 @@ POLICIES = [
     "LIFO",
     "LFI",
     "LRU",
-    "MRU"
+    "MRU",
+    "PLRU",
+    "SRRIP",
+    "BRRIP",
+    "SHiP",
 ]
 
 parser = argparse.ArgumentParser(description="Generate a configuration file for a given topology")
 parser.add_argument("--policy", type=str, choices=POLICIES, help="Victim select policy")
 parser.add_argument("--burst_inv", type=int, default=0, help="Max burst invalidations")
+parser.add_argument("--shared", action="store_true", help="Track multiple sharers in the snoop filter")
+parser.add_argument("--slices", type=int, default=1, help="Snoop filter slices")
+parser.add_argument("--slice_hash", type=str, default="mod", choices=["mod", "xor"], help="Snoop slice hash")
+parser.add_argument("--slice_delay", type=int, default=0, help="Lookup latency of each snoop slice")
+parser.add_argument("--set_watermark", type=float, default=0.0, help="Snoop set occupancy for background eviction")
+parser.add_argument("--global_watermark", type=float, default=0.0, help="Snoop occupancy for background eviction")
+parser.add_argument("--mrc", type=float, default=0.0, help="Miss ratio curve sample rate of the snoop and hosts")
+parser.add_argument("--wr_ratio", type=float, default=0.0, help="Write ratio of the requests")
+parser.add_argument("--wait_wb", action="store_true", help="Release waiters after the write-back completes")
 parser.add_argument("--cfgname", type=str, help="Config file name")
 parser.add_argument("--outputdir", type=str, help="Xerxes output (sub)directory")
 Config.fill_parser(parser)
@@ -38,6 +51,15 @@ snp.eviction = args.policy
 snp.line_num = host_num * cache_size // line_size
 snp.max_burst_inv = args.burst_inv
 snp.ranges = [[0, all_footprint]]
+snp.multi_sharer = args.shared
+snp.wait_write_back = args.wait_wb
+snp.set_watermark = args.set_watermark
+snp.global_watermark = args.global_watermark
+snp.slices = args.slices
+snp.mrc_sample_rate = args.mrc
+snp.slice_hash = args.slice_hash
+if args.slice_delay > 0:
+    snp.slice_delay = [args.slice_delay] * args.slices
 cfg.add_devices([snp])
 
 hosts = []
@@ -55,9 +77,10 @@ for i in range(host_num):
     host.hot_region_ratio = hot_region_ratio
     host.issue_delay = 2
     host.interleave_param = 30000
+    host.mrc_sample_rate = args.mrc
     hosts.append(host)
 mem0 = DRAMsim3Interface(name="Mem-0")
-mem0.wr_ratio = 0.0
+mem0.wr_ratio = args.wr_ratio
 mem0.capacity = all_footprint
 switch = Switch(name="OracleSwitch")
 switch.delay = 0
@@ -57,6 +57,7 @@ typedef enum {
     BUS_QUEUE_DELAY,
     BUS_TIME,
     FRAMING_TIME,
+    LINK_RETRY_DELAY,
     SWITCH_QUEUE_DELAY,
     SWITCH_TIME,
     PACKAGING_DELAY,
@@ -82,6 +83,8 @@ class StatKeys {
             return std::string("bus time");
         case FRAMING_TIME:
             return std::string("framing time");
+        case LINK_RETRY_DELAY:
+            return std::string("link retry delay");
         case SWITCH_TIME:
             return std::string("switch time");
         case PACKAGING_DELAY:
@@ -338,6 +341,16 @@ class Timeline {
         }
         return ret;
     }
+
+    // Same search as transfer_time(), but nothing is reserved.
+    Tick next_free(Tick arrive, Tick delay) const {
+        auto it = scopes.lower_bound(arrive);
+        while (it != scopes.end() &&
+               it->second.end - std::max(it->second.start, arrive) < delay)
+            it++;
+        ASSERT(it != scopes.end(), "Cannot find scope");
+        return std::max(it->second.start, arrive);
+    }
 };
 } // namespace xerxes
 
@@ -17,8 +17,8 @@ class Device {
     TopoID self;
     std::string name_;
 
-    // Schedule one transit event.
-    void sched_transit(Tick tick);
+    // Schedule one transit event, which handles `count` packets.
+    void sched_transit(Tick tick, size_t count = 1);
 
     void send_pkt_to(Packet pkt, TopoID dst) {
         auto to = topology->next_node(self, dst);
@@ -32,6 +32,28 @@ class Device {
 
     void send_pkt(Packet pkt) { send_pkt_to(pkt, pkt.dst); }
 
+    // Send packets in order. Consecutive packets to the same next hop at the
+    // same tick are handled by a single transit event there.
+    void send_pkts(std::vector<Packet> &pkts) {
+        for (size_t i = 0; i < pkts.size();) {
+            auto to = topology->next_node(self, pkts[i].dst);
+            auto tick = pkts[i].arrive;
+            size_t n = 0;
+            for (; i + n < pkts.size(); ++n) {
+                auto &pkt = pkts[i + n];
+                if (pkt.arrive != tick ||
+                    (n > 0 && topology->next_node(self, pkt.dst) != to))
+                    break;
+                pkt.from = self;
+                if (to != nullptr)
+                    to->send(pkt);
+            }
+            if (to != nullptr)
+                sim->system()->find_dev(to->id())->sched_transit(tick, n);
+            i += n;
+        }
+    }
+
     // Receive a packet from the TopoNode's buffer.
     Packet receive_pkt() {
         auto pkt = Packet{};
@@ -45,9 +67,9 @@ class Device {
     }
 
     void log_transit_normal(const Packet &pkt) {
-        XerxesLogger::debug()
-            << name() << " transit packet " << pkt.id << " from " << pkt.from
-            << " to " << pkt.dst << " at " << pkt.arrive << std::endl;
+        DEBUG_LOG(name() << " transit packet " << pkt.id << " from " << pkt.from
+                         << " to " << pkt.dst << " at " << pkt.arrive
+                         << std::endl);
     }
 
   public:
@@ -2,12 +2,18 @@
 #ifndef XERXES_DRAMSIM3_INTERFACE_HH
 #define XERXES_DRAMSIM3_INTERFACE_HH
 
+#include "DRAMsim3/src/configuration.h"
 #include "DRAMsim3/src/memory_system.h"
-#include "device.hh"
+#include "host_cache.hh"
+#include "host_prefetcher.hh"
+#include "memory_endpoint.hh"
 #include "utils.hh"
 
+#include <deque>
 #include <list>
 #include <map>
+#include <set>
+#include <unordered_map>
 
 namespace xerxes {
 
@@ -20,73 +26,259 @@ class DRAMsim3InterfaceConfig {
     double wr_ratio = 0.5;
     std::string config_file = "DRAMsim3/configs/DDR4_8Gb_x8_3200.ini";
     std::string output_dir = "output";
+    // On-device SRAM buffer in front of DRAM, in 64B lines (0 disables).
+    // Reads look it up in buffer_delay, and skip DRAM on a hit. Writes go
+    // through to DRAM.
+    size_t buffer_capacity = 0;
+    size_t buffer_assoc = 16;
+    Tick buffer_delay = 4;
+    // Prefetcher filling the buffer, trained by the reads of the device.
+    PrefetchConfig prefetch;
 };
 } // namespace xerxes
 TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::DRAMsim3InterfaceConfig,
                                        tick_per_clock, process_time, start,
                                        capacity, wr_ratio, config_file,
-                                       output_dir);
+                                       output_dir, buffer_capacity,
+                                       buffer_assoc, buffer_delay, prefetch);
 namespace xerxes {
-class DRAMsim3Interface : public Device {
+class DRAMsim3Interface : public MemoryEndpoint {
   private:
-    Addr start;
-    size_t capa;
-    double ratio;
-    std::vector<Packet> pending;
-    std::map<Addr, std::list<Packet>> issued;
+    static constexpr size_t LINE = 64;
+    static constexpr Tick NOT_REJECTED = (Tick)-1;
 
+    // Packets in DRAMsim3, by device address.
+    std::map<Addr, std::list<Packet>> issued;
     Tick tick_per_clock;
     Tick interface_clock = 0;
     Tick process_time;
 
     dramsim3::MemorySystem memsys;
+    // The address mapping of memsys.
+    dramsim3::Config mapping;
+
+    // A packet waiting for DRAMsim3, with its device address.
+    struct Pending {
+        uint64_t seq;
+        Addr addr;
+        Packet pkt;
+    };
+    // DRAMsim3 accepts a transaction by the transaction queue of its
+    // channel (for reads or writes, unless unified), so waiting packets are
+    // kept in a FIFO per such queue.
+    std::vector<std::deque<Pending>> queues;
+    // Queues that may accept their heads, by arrival order of the heads.
+    std::set<std::pair<uint64_t, size_t>> ready;
+    // Queues that rejected their heads, until the next DRAM clock.
+    std::vector<size_t> blocked;
+    std::vector<Tick> rejected_at;
+    uint64_t pending_seq = 0;
+    size_t pending_num = 0;
+
+    CacheLevel buffer;
+    Tick buffer_delay;
+    Prefetcher *prefetcher;
+    std::string prefetch_type;
+    // Lines the last read asked to prefetch.
+    std::vector<Addr> pf_lines;
+    // Reads waiting for the prefetch of their line, by device line.
+    std::unordered_map<Addr, std::vector<Packet>> waiting;
+    // DRAM accesses, logged with the buffer.
+    double dram_reads = 0;
+    double dram_writes = 0;
+    double prefetch_reads = 0;
+    // Responses held while the memory is clocked off the main thread, as
+    // sending touches the topology and the event queue. Packet statistics
+    // and debug logs are global too, so they are held as well.
+    struct HeldStat {
+        Packet pkt;
+        NormalStatType key;
+        double value;
+    };
+    bool holding = false;
+    std::vector<Packet> held;
+    std::vector<HeldStat> held_stats;
+    std::vector<std::pair<PktID, Tick>> held_callbacks;
+
+    void delta_stat(Packet &pkt, NormalStatType key, double value) {
+        if (holding)
+            held_stats.push_back({pkt, key, value});
+        else
+            pkt.delta_stat(key, value);
+    }
+
+    size_t queue_of(Addr addr, bool is_write) const {
+        auto channel = mapping.AddressMapping(addr).channel;
+        return channel * 2 + (mapping.unified_queue ? 0 : is_write);
+    }
+
+    void enqueue(Packet &pkt) {
+        // Prefetches carry device addresses.
+        auto addr = pkt.src == self ? pkt.addr : device_addr(pkt.addr);
+        auto i = queue_of(addr, pkt.is_write());
+        auto &q = queues[i];
+        if (q.empty() && rejected_at[i] == NOT_REJECTED)
+            ready.insert({pending_seq, i});
+        q.push_back({pending_seq++, addr, pkt});
+        pending_num++;
+    }
+
+    // The DRAM clock moved on, rejected queues may accept again.
+    void unblock() {
+        for (size_t j = 0; j < blocked.size();) {
+            auto i = blocked[j];
+            if (rejected_at[i] == interface_clock) {
+                ++j;
+                continue;
+            }
+            rejected_at[i] = NOT_REJECTED;
+            ready.insert({queues[i].front().seq, i});
+            blocked[j] = blocked.back();
+            blocked.pop_back();
+        }
+    }
 
-    // Issue packets to the DRAM system.
+    // Issue packets to the DRAM system, in arrival order as long as their
+    // queues accept them.
     void issue() {
-        std::vector<std::vector<Packet>::iterator> to_erase;
-        // Try to issue all pending packets.
-        for (auto it = pending.begin(); it != pending.end(); ++it) {
-            auto &pkt = *it;
+        unblock();
+        while (!ready.empty()) {
+            auto i = ready.begin()->second;
+            ready.erase(ready.begin());
+            auto &q = queues[i];
+            auto &head = q.front();
+            auto &pkt = head.pkt;
             // Tick to the packet arrival
-            while ((interface_clock * tick_per_clock) < pkt.arrive) {
-                memsys.ClockTick();
-                ++interface_clock;
-            }
-            if (memsys.WillAcceptTransaction(pkt.addr - start,
-                                             pkt.is_write())) {
-                if (issued.find(pkt.addr) == issued.end())
-                    issued[pkt.addr] = std::list<Packet>();
-                issued[pkt.addr].push_back(pkt);
-                to_erase.push_back(it);
-                if (interface_clock * tick_per_clock > pkt.arrive) {
-                    pkt.delta_stat(DRAM_INTERFACE_QUEUING_DELAY,
-                                   (double)(interface_clock * tick_per_clock -
-                                            pkt.arrive));
-                    pkt.arrive = interface_clock * tick_per_clock;
+            if ((interface_clock * tick_per_clock) < pkt.arrive) {
+                while ((interface_clock * tick_per_clock) < pkt.arrive) {
+                    memsys.ClockTick();
+                    ++interface_clock;
                 }
-                memsys.AddTransaction(pkt.addr - start, pkt.is_write());
+                unblock();
+            }
+            auto addr = head.addr;
+            if (!memsys.WillAcceptTransaction(addr, pkt.is_write())) {
+                rejected_at[i] = interface_clock;
+                blocked.push_back(i);
+                continue;
+            }
+            if (issued.find(addr) == issued.end())
+                issued[addr] = std::list<Packet>();
+            if (interface_clock * tick_per_clock > pkt.arrive) {
+                delta_stat(pkt, DRAM_INTERFACE_QUEUING_DELAY,
+                           (double)(interface_clock * tick_per_clock -
+                                    pkt.arrive));
+                pkt.arrive = interface_clock * tick_per_clock;
             }
+            issued[addr].push_back(pkt);
+            memsys.AddTransaction(addr, pkt.is_write());
+            q.pop_front();
+            pending_num--;
+            if (!q.empty())
+                ready.insert({q.front().seq, i});
+        }
+    }
+
+    // Look up the buffer for a request. Returns true if it is served
+    // without a DRAM access of its own.
+    bool buffered(Packet &pkt) {
+        if (!buffer.enabled() || pkt.is_write())
+            return false;
+        auto line = device_addr(pkt.addr) / LINE;
+        bool hit = buffer.hit(line, false);
+        pkt.delta_stat(DEVICE_PROCESS_TIME, (double)buffer_delay);
+        pkt.arrive += buffer_delay;
+        if (prefetcher != nullptr) {
+            prefetcher->access(line, hit);
+            prefetcher->train(line, !hit, pf_lines);
         }
-        for (auto it : to_erase) {
-            pending.erase(it);
+        if (hit) {
+            respond(pkt);
+            return true;
         }
+        if (prefetcher != nullptr && prefetcher->pending(line)) {
+            waiting[line].push_back(pkt);
+            return true;
+        }
+        return false;
+    }
+
+    // Queue DRAM reads for the lines the prefetcher asked for.
+    void prefetch(Tick tick) {
+        for (auto line : pf_lines) {
+            if (prefetcher->pending(line) || buffer.contains(line) ||
+                line * LINE >= capa)
+                continue;
+            auto pkt = PktBuilder()
+                           .src(self)
+                           .dst(self)
+                           .addr(line * LINE)
+                           .sent(tick)
+                           .payload(0)
+                           .burst(1)
+                           .type(PacketType::NT_RD)
+                           .build();
+            prefetcher->issue(line);
+            enqueue(pkt);
+        }
+        pf_lines.clear();
+    }
+
+    // The data of a prefetch arrived, and serves the reads waiting for it.
+    void prefetched(const Packet &pkt) {
+        auto line = pkt.addr / LINE;
+        buffer.insert(line, false);
+        prefetcher->fill(line);
+        auto it = waiting.find(line);
+        if (it == waiting.end())
+            return;
+        for (auto &wait : it->second) {
+            if (pkt.arrive > wait.arrive) {
+                delta_stat(wait, DRAM_TIME, (double)(pkt.arrive - wait.arrive));
+                wait.arrive = pkt.arrive;
+            }
+            respond(wait);
+        }
+        waiting.erase(it);
+    }
+
+    void respond(Packet &pkt) {
+        std::swap(pkt.src, pkt.dst);
+        pkt.is_rsp = true;
+        if (pkt.is_write())
+            pkt.payload = 0;
+        else
+            pkt.payload = 64;
+        if (holding)
+            held.push_back(pkt);
+        else
+            send_pkt(pkt);
     }
 
   public:
     DRAMsim3Interface(Simulation *sim, const DRAMsim3InterfaceConfig &config,
                       std::string name = "DRAMsim3Interface")
-        : Device(sim, name), start(config.start), capa(config.capacity),
-          ratio(config.wr_ratio), tick_per_clock(config.tick_per_clock),
+        : MemoryEndpoint(sim, config.start, config.capacity, config.wr_ratio,
+                         name),
+          tick_per_clock(config.tick_per_clock),
           process_time(config.process_time),
           memsys(config.config_file, config.output_dir,
                  std::bind(&DRAMsim3Interface::callback, this,
                            std::placeholders::_1),
                  std::bind(&DRAMsim3Interface::callback, this,
-                           std::placeholders::_1)) {}
+                           std::placeholders::_1)),
+          mapping(config.config_file, config.output_dir),
+          queues(mapping.channels * 2),
+          rejected_at(queues.size(), NOT_REJECTED),
+          buffer(config.buffer_capacity, config.buffer_assoc),
+          buffer_delay(config.buffer_delay),
+          prefetcher(Prefetcher::make(config.prefetch)),
+          prefetch_type(config.prefetch.type) {
+        ASSERT(prefetcher == nullptr || buffer.enabled(),
+               name + ": prefetching needs the buffer (buffer_capacity)");
+    }
 
-    Addr start_addr() const { return start; }
-    size_t capacity() const { return capa; }
-    double wr_ratio() const { return ratio; }
+    ~DRAMsim3Interface() { delete prefetcher; }
 
     void transit() override {
         auto pkt = receive_pkt();
@@ -97,7 +289,10 @@ class DRAMsim3Interface : public Device {
                     << pkt.from << " at " << pkt.arrive << std::endl;
                 pkt.delta_stat(DEVICE_PROCESS_TIME, (double)(process_time));
                 pkt.arrive += process_time;
-                pending.push_back(pkt);
+                if (!buffered(pkt))
+                    enqueue(pkt);
+                if (!pf_lines.empty())
+                    prefetch(pkt.arrive);
             } else {
                 send_pkt(pkt);
             }
@@ -108,40 +303,84 @@ class DRAMsim3Interface : public Device {
 
     // Callback function called by DRAMsim3 when a packet is completed.
     void callback(Addr addr) {
-        auto it = issued.find(addr + start);
+        auto it = issued.find(addr);
         if (it == issued.end())
             return;
-        auto &pkt = it->second.front();
-        XerxesLogger::debug() << "Callback #" << pkt.id << "r at "
-                              << interface_clock * tick_per_clock << std::endl;
-        std::swap(pkt.src, pkt.dst);
+        auto pkt = it->second.front();
+        it->second.pop_front();
+        if (it->second.empty())
+            issued.erase(it); // Save memory
+        if (holding)
+            held_callbacks.push_back(
+                {pkt.id, interface_clock * tick_per_clock});
+        else
+            XerxesLogger::debug()
+                << "Callback #" << pkt.id << "r at "
+                << interface_clock * tick_per_clock << std::endl;
 
         // TODO: is the callback called at the exact tick?
-        pkt.delta_stat(DRAM_TIME,
-                       (double)(interface_clock * tick_per_clock - pkt.arrive));
+        delta_stat(pkt, DRAM_TIME,
+                   (double)(interface_clock * tick_per_clock - pkt.arrive));
         pkt.arrive = interface_clock * tick_per_clock;
-        pkt.is_rsp = true;
-        if (pkt.is_write())
-            pkt.payload = 0;
-        else
-            pkt.payload = 64;
-        send_pkt(pkt);
+        if (pkt.src == self) {
+            prefetch_reads += 1;
+            prefetched(pkt);
+            return;
+        }
+        if (pkt.is_write()) {
+            dram_writes += 1;
+        } else {
+            dram_reads += 1;
+            if (buffer.enabled())
+                buffer.insert(addr / LINE, false);
+        }
+        respond(pkt);
+    }
 
-        it->second.pop_front();
-        if (it->second.empty())
-            issued.erase(it); // Save memory
+    void log_stats(std::ostream &os) override {
+        if (!buffer.enabled())
+            return;
+        auto elapsed = interface_clock * tick_per_clock;
+        os << name() << " stats: " << std::endl;
+        os << " * Buffer hit/miss: " << buffer.hits << "/" << buffer.misses
+           << std::endl;
+        os << " * DRAM reads/writes/prefetches: " << dram_reads << "/"
+           << dram_writes << "/" << prefetch_reads << std::endl;
+        os << " * DRAM bandwidth demand/prefetch (GB/s): "
+           << (elapsed > 0 ? (dram_reads + dram_writes) * LINE / elapsed : 0)
+           << "/" << (elapsed > 0 ? prefetch_reads * LINE / elapsed : 0)
+           << std::endl;
+        if (prefetcher != nullptr)
+            prefetcher->log_stats(os, prefetch_type, LINE, elapsed);
+    }
+
+    // Hold responses until release_responses(), which applies the held
+    // statistics and sends the responses in order, on the calling thread.
+    void hold_responses() { holding = true; }
+    void release_responses() {
+        holding = false;
+        for (auto &cb : held_callbacks)
+            XerxesLogger::debug() << "Callback #" << cb.first << "r at "
+                                  << cb.second << std::endl;
+        for (auto &stat : held_stats)
+            stat.pkt.delta_stat(stat.key, stat.value);
+        for (auto &pkt : held)
+            send_pkt(pkt);
+        held_callbacks.clear();
+        held_stats.clear();
+        held.clear();
     }
 
     Tick clock() {
         auto num = issued.size();
         if (num == 0) {
-            if (!pending.empty())
+            if (pending_num > 0)
                 issue();
             return interface_clock * tick_per_clock;
         }
         memsys.ClockTick();
         ++interface_clock;
-        if (num != issued.size() && !pending.empty())
+        if (num != issued.size() && pending_num > 0)
             issue();
         return interface_clock * tick_per_clock;
     }
@@ -152,14 +391,14 @@ class DRAMsim3Interface : public Device {
             memsys.ClockTick();
             ++interface_clock;
         }
-        if (num == 0 && !pending.empty()) {
-            while (issued.size() == 0 && !pending.empty()) {
+        if (num == 0 && pending_num > 0) {
+            while (issued.size() == 0 && pending_num > 0) {
                 memsys.ClockTick();
                 ++interface_clock;
                 issue();
             }
         }
-        if (issued.size() == 0 && pending.empty()) {
+        if (issued.size() == 0 && pending_num == 0) {
             return false;
         }
         return true;
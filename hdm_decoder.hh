@@ -0,0 +1,157 @@
+#pragma once
+#ifndef XERXES_HDM_DECODER_HH
+#define XERXES_HDM_DECODER_HH
+
+#include "def.hh"
+#include "ext/toml.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace xerxes {
+// A CXL HDM (host-managed device memory) decoder: the host physical address
+// window [base, base + size) interleaved over `targets` in chunks of
+// `granularity` bytes.
+struct HDMDecoderConfig {
+    Addr base = 0;
+    size_t size = 0;
+    // Interleave granularity in bytes, a power of 2 in [256, 16K].
+    size_t granularity = 256;
+    // "none": chunk i goes to target i % ways. "xor": the target index is
+    // further XORed with the upper address bits, folded to the way bits
+    // (power-of-2 ways only).
+    std::string hash = "none";
+    // Names of the memory devices, the way count is their number.
+    std::vector<std::string> targets;
+};
+} // namespace xerxes
+
+TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::HDMDecoderConfig, base, size,
+                                       granularity, hash, targets);
+
+namespace xerxes {
+class HDMDecoder {
+    Addr base;
+    size_t size;
+    size_t granularity;
+    size_t ways;
+    // log2(ways) for XOR hashing, 0 for modulo interleaving.
+    size_t xor_bits = 0;
+    std::vector<TopoID> targets;
+
+  public:
+    HDMDecoder(const HDMDecoderConfig &config,
+               const std::vector<TopoID> &targets)
+        : base(config.base), size(config.size),
+          granularity(config.granularity), ways(targets.size()),
+          targets(targets) {
+        auto is_pow2 = [](size_t v) { return v != 0 && (v & (v - 1)) == 0; };
+        ASSERT(is_pow2(granularity) && granularity >= 256 &&
+                   granularity <= 16384,
+               "HDM decoder: granularity should be a power of 2 in [256, 16K]");
+        ASSERT(ways == 1 || ways == 2 || ways == 3 || ways == 4 || ways == 6 ||
+                   ways == 8 || ways == 12 || ways == 16,
+               "HDM decoder: ways should be 1, 2, 3, 4, 6, 8, 12 or 16");
+        ASSERT(size > 0 && size % (granularity * ways) == 0,
+               "HDM decoder: size should be a multiple of granularity * ways");
+        for (size_t i = 0; i < ways; ++i)
+            ASSERT(std::count(targets.begin(), targets.end(), targets[i]) == 1,
+                   "HDM decoder: a target appears more than once");
+        ASSERT(base % granularity == 0,
+               "HDM decoder: base should be aligned to granularity");
+        if (config.hash == "xor") {
+            ASSERT(is_pow2(ways), "HDM decoder: XOR hash needs 2^n ways");
+            while (((size_t)1 << xor_bits) < ways)
+                ++xor_bits;
+        } else {
+            ASSERT(config.hash == "none",
+                   "HDM decoder: unknown hash " + config.hash);
+        }
+    }
+
+    Addr start() const { return base; }
+    size_t capacity() const { return size; }
+    bool contains(Addr hpa) const { return hpa >= base && hpa - base < size; }
+    const std::vector<TopoID> &target_list() const { return targets; }
+    // Whether both decoders interleave the same way over the same targets.
+    bool same_interleave(const HDMDecoder &other) const {
+        return granularity == other.granularity &&
+               xor_bits == other.xor_bits && targets == other.targets;
+    }
+
+    // Target index of an address in the window.
+    size_t way(Addr hpa) const {
+        auto chunk = (hpa - base) / granularity;
+        auto row = chunk / ways;
+        size_t w = chunk % ways;
+        if (xor_bits > 0) {
+            // The row is the same for all ways of a chunk row, so XOR
+            // permutes the ways in each row.
+            for (; row != 0; row >>= xor_bits)
+                w ^= row & (ways - 1);
+        }
+        return w;
+    }
+
+    TopoID target(Addr hpa) const { return targets[way(hpa)]; }
+
+    // Offset of an address in its target's share of the window.
+    Addr device_offset(Addr hpa) const {
+        auto off = hpa - base;
+        return off / (granularity * ways) * granularity + off % granularity;
+    }
+};
+
+// The HDM decoders of a host. The decoded windows are treated as one flat
+// space [0, capacity()) of offsets when requests are generated.
+class AddressMap {
+    std::vector<HDMDecoder> decoders;
+    size_t total = 0;
+
+  public:
+    void add(const HDMDecoder &decoder) {
+        for (auto &d : decoders)
+            ASSERT(decoder.start() >= d.start() + d.capacity() ||
+                       d.start() >= decoder.start() + decoder.capacity(),
+                   "HDM decoders overlap");
+        decoders.push_back(decoder);
+        std::sort(decoders.begin(), decoders.end(),
+                  [](const HDMDecoder &a, const HDMDecoder &b) {
+                      return a.start() < b.start();
+                  });
+        total += decoder.capacity();
+    }
+
+    bool enabled() const { return !decoders.empty(); }
+    size_t capacity() const { return total; }
+    const std::vector<HDMDecoder> &list() const { return decoders; }
+
+    // Host address of an offset into the decoded space.
+    Addr address(Addr offset) const {
+        offset %= total;
+        for (auto &d : decoders) {
+            if (offset < d.capacity())
+                return d.start() + offset;
+            offset -= d.capacity();
+        }
+        return 0;
+    }
+
+    const HDMDecoder *find(Addr hpa) const {
+        for (auto &d : decoders)
+            if (d.contains(hpa))
+                return &d;
+        return nullptr;
+    }
+
+    TopoID target(Addr hpa) const {
+        auto d = find(hpa);
+        if (d == nullptr)
+            PANIC("Address is not decoded by any HDM decoder");
+        return d->target(hpa);
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_HDM_DECODER_HH
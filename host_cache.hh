@@ -0,0 +1,250 @@
+#pragma once
+#ifndef XERXES_HOST_CACHE_HH
+#define XERXES_HOST_CACHE_HH
+
+#include "def.hh"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace xerxes {
+// One set-associative LRU cache level. Lines are kept in flat per-way
+// arrays (index `set_i * assoc + way_i`), so a lookup scans one set only.
+class CacheLevel {
+  public:
+    struct Victim {
+        bool valid;
+        Addr line;
+        bool dirty;
+    };
+
+    Tick delay;
+    // Statistics.
+    double hits = 0;
+    double misses = 0;
+
+  private:
+    size_t assoc;
+    size_t set_num;
+    std::vector<Addr> tags;
+    std::vector<uint64_t> stamps;
+    std::vector<bool> valid;
+    std::vector<bool> dirty;
+    uint64_t clock = 0;
+
+    size_t index(size_t set_i, size_t way_i) { return set_i * assoc + way_i; }
+
+    ssize_t find(Addr line) {
+        if (set_num == 0)
+            return -1;
+        auto base = index(line % set_num, 0);
+        for (size_t w = 0; w < assoc; ++w)
+            if (valid[base + w] && tags[base + w] == line)
+                return base + w;
+        return -1;
+    }
+
+  public:
+    // A capacity of 0 makes a disabled level.
+    CacheLevel(size_t capacity = 0, size_t assoc = 1, Tick delay = 0)
+        : delay(delay), assoc(assoc), set_num(assoc ? capacity / assoc : 0) {
+        ASSERT(capacity == 0 || set_num > 0,
+               "cache: capacity is smaller than assoc");
+        tags.resize(set_num * assoc, 0);
+        stamps.resize(set_num * assoc, 0);
+        valid.resize(set_num * assoc, false);
+        dirty.resize(set_num * assoc, false);
+    }
+
+    bool enabled() { return set_num > 0; }
+    size_t capacity() { return set_num * assoc; }
+    bool contains(Addr line) { return find(line) != -1; }
+
+    bool hit(Addr line, bool is_write) {
+        auto i = find(line);
+        if (i == -1) {
+            misses += 1;
+            return false;
+        }
+        hits += 1;
+        stamps[i] = ++clock;
+        if (is_write)
+            dirty[i] = true;
+        return true;
+    }
+
+    // Insert (or refresh) a line. Returns the line evicted for it, if any.
+    Victim insert(Addr line, bool is_dirty) {
+        auto i = find(line);
+        if (i != -1) {
+            stamps[i] = ++clock;
+            if (is_dirty)
+                dirty[i] = true;
+            return {false, 0, false};
+        }
+        auto base = index(line % set_num, 0);
+        size_t way = base;
+        for (size_t w = base; w < base + assoc; ++w) {
+            if (!valid[w]) {
+                way = w;
+                break;
+            }
+            if (stamps[w] < stamps[way])
+                way = w;
+        }
+        Victim victim{valid[way], tags[way], valid[way] && dirty[way]};
+        tags[way] = line;
+        stamps[way] = ++clock;
+        valid[way] = true;
+        dirty[way] = is_dirty;
+        return victim;
+    }
+
+    void set_dirty(Addr line) {
+        auto i = find(line);
+        if (i != -1)
+            dirty[i] = true;
+    }
+
+    // Drop a line. Returns true if it was dirty.
+    bool invalidate(Addr line) {
+        auto i = find(line);
+        if (i == -1)
+            return false;
+        valid[i] = false;
+        bool was_dirty = dirty[i];
+        dirty[i] = false;
+        return was_dirty;
+    }
+};
+
+// Host cache hierarchy: optional private L1/L2 per core and a shared LLC.
+// Every level is inclusive of the levels above it, so evicting a line from
+// a level drops the copies above, and their dirty data moves down.
+class CacheHierarchy {
+    size_t line_size;
+    std::vector<CacheLevel> l1;
+    std::vector<CacheLevel> l2;
+    CacheLevel llc;
+
+    // Enabled levels seen by a core, from the top.
+    size_t path(size_t core, CacheLevel *levels[3]) {
+        size_t n = 0;
+        if (l1[core].enabled())
+            levels[n++] = &l1[core];
+        if (l2[core].enabled())
+            levels[n++] = &l2[core];
+        levels[n++] = &llc;
+        return n;
+    }
+
+    // Keep inclusion after the n-th level of a core evicted a victim.
+    void evicted(size_t core, size_t n, CacheLevel::Victim victim) {
+        CacheLevel *levels[3];
+        auto depth = path(core, levels);
+        bool is_dirty = victim.dirty;
+        if (n + 1 == depth) {
+            // The shared LLC evicts from every core.
+            for (size_t c = 0; c < l1.size(); ++c) {
+                is_dirty |= l1[c].invalidate(victim.line);
+                is_dirty |= l2[c].invalidate(victim.line);
+            }
+            if (is_dirty)
+                dirty_evictions += 1;
+            return;
+        }
+        for (size_t i = 0; i < n; ++i)
+            is_dirty |= levels[i]->invalidate(victim.line);
+        if (is_dirty)
+            levels[n + 1]->set_dirty(victim.line);
+    }
+
+    // Install a line into the levels [0, n) of a core, bottom first.
+    void fill(size_t core, size_t n, Addr line, bool is_dirty) {
+        CacheLevel *levels[3];
+        path(core, levels);
+        for (size_t i = n; i-- > 0;) {
+            auto victim = levels[i]->insert(line, is_dirty && i == 0);
+            if (victim.valid)
+                evicted(core, i, victim);
+        }
+    }
+
+  public:
+    // Dirty lines dropped by the LLC. Their write-back is not modeled.
+    double dirty_evictions = 0;
+
+    CacheHierarchy(size_t cores, size_t line_size, const CacheLevel &l1_level,
+                   const CacheLevel &l2_level, const CacheLevel &llc_level)
+        : line_size(line_size), l1(cores, l1_level), l2(cores, l2_level),
+          llc(llc_level) {
+        ASSERT(llc.enabled(), "cache: LLC capacity is 0");
+    }
+
+    // Look up addr from the top level down. Returns the lookup latency, and
+    // refills the levels above the hit one.
+    Tick access(size_t core, Addr addr, bool is_write, bool &hit) {
+        auto line = addr / line_size;
+        CacheLevel *levels[3];
+        auto depth = path(core, levels);
+        Tick delay = 0;
+        for (size_t i = 0; i < depth; ++i) {
+            delay += levels[i]->delay;
+            if (levels[i]->hit(line, is_write && i == 0)) {
+                fill(core, i, line, is_write);
+                hit = true;
+                return delay;
+            }
+        }
+        hit = false;
+        return delay;
+    }
+
+    // Data of a miss arrived.
+    void fill(size_t core, Addr addr, bool is_write) {
+        CacheLevel *levels[3];
+        fill(core, path(core, levels), addr / line_size, is_write);
+    }
+
+    // Invalidate a line in every level. Returns true if any copy was dirty.
+    bool invalidate(Addr addr) {
+        auto line = addr / line_size;
+        bool is_dirty = llc.invalidate(line);
+        for (size_t c = 0; c < l1.size(); ++c) {
+            is_dirty |= l1[c].invalidate(line);
+            is_dirty |= l2[c].invalidate(line);
+        }
+        return is_dirty;
+    }
+
+    // Whether a line is cached, without touching the LRU state.
+    bool contains(Addr addr) { return llc.contains(addr / line_size); }
+
+    // Probe latency of an invalidation, the LLC tracks all lines.
+    Tick inv_delay() { return llc.delay; }
+    size_t capacity() { return llc.capacity(); }
+
+    void log_stats(std::ostream &os) {
+        auto log_level = [&os](const std::string &name,
+                               std::vector<CacheLevel> &levels) {
+            double hits = 0, misses = 0;
+            for (auto &level : levels) {
+                hits += level.hits;
+                misses += level.misses;
+            }
+            if (levels.empty() || !levels[0].enabled())
+                return;
+            os << " * " << name << " hit/miss: " << hits << "/" << misses
+               << std::endl;
+        };
+        log_level("L1", l1);
+        log_level("L2", l2);
+        os << " * LLC hit/miss: " << llc.hits << "/" << llc.misses
+           << std::endl;
+        os << " * LLC dirty eviction count: " << dirty_evictions << std::endl;
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_HOST_CACHE_HH
@@ -0,0 +1,256 @@
+#pragma once
+#ifndef XERXES_HOST_PREFETCHER_HH
+#define XERXES_HOST_PREFETCHER_HH
+
+#include "def.hh"
+#include "ext/toml.hpp"
+
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace xerxes {
+// Hardware prefetcher in front of the host cache.
+struct PrefetchConfig {
+    // "none", "next_line", "stride" or "stream".
+    std::string type = "none";
+    // Lines prefetched per trigger, and how many lines (strides for
+    // "stride") ahead of the access the first one is.
+    size_t degree = 1;
+    size_t distance = 1;
+    // Entries of the stride table, or stream buffers.
+    size_t table_size = 16;
+};
+} // namespace xerxes
+
+TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::PrefetchConfig, type, degree,
+                                       distance, table_size);
+
+namespace xerxes {
+// A prefetcher is trained by the demand accesses of the cache, in lines,
+// and proposes lines to prefetch. The base class keeps track of the
+// prefetched lines to tell how useful they are.
+class Prefetcher {
+  protected:
+    size_t degree;
+    size_t distance;
+    size_t table_size;
+
+  private:
+    // Prefetches in flight, and whether a demand miss overtook them.
+    std::unordered_map<Addr, bool> inflight;
+    // Prefetched lines not used yet.
+    std::unordered_set<Addr> unused;
+
+    // Statistics.
+    double issued = 0;
+    double useful = 0;
+    double late = 0;
+    double demand_misses = 0;
+
+  public:
+    Prefetcher(const PrefetchConfig &config)
+        : degree(config.degree), distance(config.distance),
+          table_size(config.table_size) {
+        ASSERT(degree > 0, "prefetcher: degree should be positive");
+        ASSERT(distance > 0, "prefetcher: distance should be positive");
+        ASSERT(table_size > 0, "prefetcher: table_size should be positive");
+    }
+    virtual ~Prefetcher() {}
+
+    static Prefetcher *make(const PrefetchConfig &config);
+
+    // Learn from a demand access, and append the lines to prefetch.
+    virtual void train(Addr line, bool miss, std::vector<Addr> &lines) = 0;
+
+    // A demand access to a line, hit or missed in the cache.
+    void access(Addr line, bool hit) {
+        if (hit) {
+            useful += unused.erase(line);
+            return;
+        }
+        demand_misses += 1;
+        // Evicted before its use.
+        unused.erase(line);
+        auto it = inflight.find(line);
+        if (it != inflight.end() && !it->second) {
+            it->second = true;
+            late += 1;
+        }
+    }
+
+    bool pending(Addr line) { return inflight.count(line) > 0; }
+
+    void issue(Addr line) {
+        inflight[line] = false;
+        issued += 1;
+    }
+
+    // The data of a prefetch arrived.
+    void fill(Addr line) {
+        auto it = inflight.find(line);
+        if (it == inflight.end())
+            return;
+        if (!it->second)
+            unused.insert(line);
+        inflight.erase(it);
+    }
+
+    // Prefetch traffic is `bytes` per prefetch over `elapsed` ticks.
+    void log_stats(std::ostream &os, const std::string &type, size_t bytes,
+                   Tick elapsed) {
+        auto wasted = issued - useful - late;
+        os << " * Prefetcher (" << type << "): " << std::endl;
+        os << "   - Issued/useful/late/unused: " << issued << "/" << useful
+           << "/" << late << "/" << wasted << std::endl;
+        os << "   - Accuracy: " << (issued > 0 ? useful / issued : 0)
+           << std::endl;
+        // Demand misses include the late prefetches.
+        os << "   - Coverage: "
+           << (useful + demand_misses > 0
+                   ? useful / (useful + demand_misses)
+                   : 0)
+           << std::endl;
+        os << "   - Timeliness: "
+           << (useful + late > 0 ? useful / (useful + late) : 0) << std::endl;
+        os << "   - Bandwidth/wasted (GB/s): "
+           << (elapsed > 0 ? issued * bytes / elapsed : 0) << "/"
+           << (elapsed > 0 ? wasted * bytes / elapsed : 0) << std::endl;
+    }
+};
+
+// Prefetch the lines after each missed line.
+class NextLinePrefetcher : public Prefetcher {
+  public:
+    NextLinePrefetcher(const PrefetchConfig &config) : Prefetcher(config) {}
+
+    void train(Addr line, bool miss, std::vector<Addr> &lines) override {
+        if (!miss)
+            return;
+        for (size_t i = 0; i < degree; ++i)
+            lines.push_back(line + distance + i);
+    }
+};
+
+// Stride prefetcher. Traces carry no PC, so accesses are told apart by
+// stream instead: an access belongs to the entry whose last line is the
+// nearest within a page, and a stride confirmed twice in a row triggers
+// prefetches.
+class StridePrefetcher : public Prefetcher {
+    static constexpr int64_t WINDOW = 64;
+
+    struct Entry {
+        Addr last;
+        int64_t stride = 0;
+        size_t confidence = 0;
+        uint64_t stamp = 0;
+    };
+    std::vector<Entry> table;
+    uint64_t clock = 0;
+
+  public:
+    StridePrefetcher(const PrefetchConfig &config) : Prefetcher(config) {}
+
+    void train(Addr line, bool miss, std::vector<Addr> &lines) override {
+        Entry *entry = nullptr;
+        int64_t best = WINDOW + 1;
+        for (auto &e : table) {
+            auto delta = std::abs((int64_t)(line - e.last));
+            if (delta < best) {
+                best = delta;
+                entry = &e;
+            }
+        }
+        if (entry == nullptr) {
+            if (table.size() < table_size) {
+                table.push_back({line});
+                entry = &table.back();
+            } else {
+                entry = &table[0];
+                for (auto &e : table)
+                    if (e.stamp < entry->stamp)
+                        entry = &e;
+                *entry = {line};
+            }
+            entry->stamp = ++clock;
+            return;
+        }
+        entry->stamp = ++clock;
+        auto stride = (int64_t)(line - entry->last);
+        if (stride == 0)
+            return;
+        if (stride == entry->stride) {
+            entry->confidence += 1;
+        } else {
+            entry->stride = stride;
+            entry->confidence = 0;
+        }
+        entry->last = line;
+        if (entry->confidence < 1)
+            return;
+        for (size_t i = 0; i < degree; ++i)
+            lines.push_back(line + stride * (int64_t)(distance + i));
+    }
+};
+
+// Stream buffers: a miss allocates a buffer that fetches the `degree`
+// lines from `distance` lines after it, and each access to the lines a
+// buffer covers moves the buffer on, to keep the same lead.
+class StreamPrefetcher : public Prefetcher {
+    struct Buffer {
+        // Next line expected, and the last line fetched.
+        Addr next;
+        Addr head;
+        uint64_t stamp;
+    };
+    std::vector<Buffer> buffers;
+    uint64_t clock = 0;
+
+  public:
+    StreamPrefetcher(const PrefetchConfig &config) : Prefetcher(config) {}
+
+    void train(Addr line, bool miss, std::vector<Addr> &lines) override {
+        for (auto &b : buffers) {
+            if (line < b.next || line > b.head)
+                continue;
+            b.stamp = ++clock;
+            b.next = line + 1;
+            for (; b.head < line + distance + degree - 1; ++b.head)
+                lines.push_back(b.head + 1);
+            return;
+        }
+        if (!miss)
+            return;
+        Buffer buffer{line + 1, line + distance - 1, ++clock};
+        for (size_t i = 0; i < degree; ++i)
+            lines.push_back(++buffer.head);
+        if (buffers.size() < table_size) {
+            buffers.push_back(buffer);
+            return;
+        }
+        auto victim = &buffers[0];
+        for (auto &b : buffers)
+            if (b.stamp < victim->stamp)
+                victim = &b;
+        *victim = buffer;
+    }
+};
+
+inline Prefetcher *Prefetcher::make(const PrefetchConfig &config) {
+    if (config.type == "none")
+        return nullptr;
+    if (config.type == "next_line")
+        return new NextLinePrefetcher(config);
+    if (config.type == "stride")
+        return new StridePrefetcher(config);
+    if (config.type == "stream")
+        return new StreamPrefetcher(config);
+    PANIC("Unknown prefetcher type: " + config.type);
+    return nullptr;
+}
+} // namespace xerxes
+
+#endif // XERXES_HOST_PREFETCHER_HH
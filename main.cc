@@ -1,5 +1,6 @@
 #include "def.hh"
 #include "dramsim3_interface.hh"
+#include "parallel_clock.hh"
 #include "requester.hh"
 #include "xerxes_standalone.hh"
 
@@ -65,20 +66,8 @@ int main(int argc, char *argv[]) {
         }
         return true;
     };
-    std::vector<xerxes::Tick> mems_tick(mems.size(), 0);
     // Ticking all memories and synchronizing them to the current tick.
-    auto clock_all_mems_to_tick = [&mems, &mems_tick, &config](
-                                      xerxes::Tick tick, bool not_changed) {
-        for (size_t i = 0; i < mems.size(); ++i)
-            mems_tick[i] = 0;
-        for (size_t i = 0; i < mems.size(); ++i) {
-            for (int g = 0;
-                 g < config.clock_granu && (mems_tick[i] < tick || not_changed);
-                 ++g) {
-                mems_tick[i] = mems[i]->clock();
-            }
-        }
-    };
+    xerxes::ParallelClock mem_clock(mems, config.threads, config.clock_granu);
 
     // Simulation.
     auto start = std::chrono::high_resolution_clock::now();
@@ -91,7 +80,7 @@ int main(int argc, char *argv[]) {
         bool not_changed = last_curt == curt;
         last_curt = curt;
         // TODO: automate clock align.
-        clock_all_mems_to_tick(curt, not_changed);
+        mem_clock.clock_to(curt, not_changed);
         clock_cnt++;
     }
 
@@ -99,7 +88,7 @@ int main(int argc, char *argv[]) {
         auto curt = xerxes::step();
         bool not_changed = last_curt == curt;
         last_curt = curt;
-        clock_all_mems_to_tick(curt, not_changed);
+        mem_clock.clock_to(curt, not_changed);
         clock_cnt++;
         if (check_all_empty()) {
             break;
@@ -0,0 +1,64 @@
+#pragma once
+#ifndef XERXES_MEMORY_ENDPOINT_HH
+#define XERXES_MEMORY_ENDPOINT_HH
+
+#include "device.hh"
+#include "hdm_decoder.hh"
+
+#include <vector>
+
+namespace xerxes {
+// A memory device at an endpoint. It serves the host addresses of its own
+// range [start, start + capacity), or of the HDM decoder windows it is a
+// target of.
+class MemoryEndpoint : public Device {
+  protected:
+    Addr start;
+    size_t capa;
+    double ratio;
+    // Device-side HDM decoders, and where their share of the host window
+    // starts in the device.
+    std::vector<std::pair<HDMDecoder, Addr>> decoders;
+    Addr decoded_top = 0;
+
+    // Host address to device address. Addresses not decoded by an HDM
+    // decoder are relative to `start`.
+    Addr device_addr(Addr hpa) const {
+        for (auto &d : decoders)
+            if (d.first.contains(hpa))
+                return d.second + d.first.device_offset(hpa);
+        return hpa - start;
+    }
+
+  public:
+    MemoryEndpoint(Simulation *sim, Addr start, size_t capacity, double ratio,
+                   std::string name)
+        : Device(sim, name), start(start), capa(capacity), ratio(ratio) {}
+
+    Addr start_addr() const { return start; }
+    size_t capacity() const { return capa; }
+    double wr_ratio() const { return ratio; }
+
+    // Decode this memory's share of a host HDM decoder window. Hosts with
+    // the same window share its device range, so they should interleave it
+    // the same way.
+    void add_decoder(const HDMDecoder &decoder) {
+        for (auto &d : decoders) {
+            if (d.first.start() == decoder.start() &&
+                d.first.capacity() == decoder.capacity()) {
+                ASSERT(d.first.same_interleave(decoder),
+                       name() + ": hosts interleave a shared HDM window "
+                                "differently");
+                return;
+            }
+        }
+        auto share = decoder.capacity() / decoder.target_list().size();
+        ASSERT(decoded_top + share <= capa,
+               name() + ": HDM decoders exceed the capacity");
+        decoders.push_back({decoder, decoded_top});
+        decoded_top += share;
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_MEMORY_ENDPOINT_HH
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef XERXES_MRC_PROFILER_HH
+#define XERXES_MRC_PROFILER_HH
+
+#include "def.hh"
+
+#include <algorithm>
+#include <map>
+#include <ostream>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace xerxes {
+// Single-pass miss ratio curve profiler, following SHARDS: only lines whose
+// address hash falls under `rate` are tracked, and their reuse (stack)
+// distances are scaled by 1 / rate. The curve models a fully associative
+// LRU cache of each size, so it is an estimate for set-associative caches
+// and other policies.
+class MRCProfiler {
+    static constexpr uint64_t MODULUS = (uint64_t)1 << 24;
+
+    double rate;
+    uint64_t threshold;
+    // Last access time of each sampled line.
+    std::unordered_map<Addr, size_t> last;
+    // Fenwick tree over access times, a time is marked if it is the last
+    // access of some line. Marks in (last, now) count the distinct lines
+    // touched since.
+    std::vector<int32_t> tree;
+    std::vector<bool> marks;
+    size_t now = 0;
+    // Scaled reuse distance -> sampled access count.
+    std::map<size_t, double> hist;
+    double cold = 0;
+    double sampled = 0;
+    double total = 0;
+
+    static uint64_t hash(Addr line) {
+        line ^= line >> 33;
+        line *= 0xff51afd7ed558ccdULL;
+        line ^= line >> 33;
+        line *= 0xc4ceb9fe1a85ec53ULL;
+        line ^= line >> 33;
+        return line;
+    }
+
+    void add(size_t t, int32_t delta) {
+        for (++t; t < tree.size(); t += t & (~t + 1))
+            tree[t] += delta;
+    }
+
+    // Marks in [0, t).
+    size_t prefix(size_t t) {
+        size_t sum = 0;
+        for (; t > 0; t -= t & (~t + 1))
+            sum += tree[t];
+        return sum;
+    }
+
+    // Make room for more access times. Only the last access of each line
+    // matters, so once most times are unmarked, the last accesses are
+    // renumbered 0, 1, ... in order. The time axis then stays within a few
+    // times the number of sampled lines.
+    void grow() {
+        std::vector<bool> old;
+        old.swap(marks);
+        bool compact = now >= 2 * last.size();
+        if (compact) {
+            std::vector<std::pair<size_t, Addr>> order;
+            order.reserve(last.size());
+            for (auto &entry : last)
+                order.push_back({entry.second, entry.first});
+            std::sort(order.begin(), order.end());
+            for (size_t t = 0; t < order.size(); ++t)
+                last[order[t].second] = t;
+            now = order.size();
+        }
+        auto n = std::max<size_t>(1024, now * 2);
+        marks.assign(n, false);
+        for (size_t t = 0; t < now; ++t)
+            marks[t] = compact || old[t];
+        // Build the tree in linear time.
+        tree.assign(n + 1, 0);
+        for (size_t t = 1; t <= n; ++t) {
+            tree[t] += marks[t - 1];
+            auto up = t + (t & (~t + 1));
+            if (up <= n)
+                tree[up] += tree[t];
+        }
+    }
+
+  public:
+    MRCProfiler(double rate = 0)
+        : rate(rate), threshold((uint64_t)(rate * MODULUS)) {
+        ASSERT(rate >= 0 && rate <= 1, "MRC sample rate should be in [0, 1]");
+    }
+
+    bool enabled() { return threshold > 0; }
+
+    void access(Addr addr) {
+        if (!enabled())
+            return;
+        total += 1;
+        auto line = addr / 64;
+        if (hash(line) % MODULUS >= threshold)
+            return;
+        sampled += 1;
+        if (now >= marks.size())
+            grow();
+        auto it = last.find(line);
+        if (it == last.end()) {
+            cold += 1;
+            last[line] = now;
+        } else {
+            auto dist = prefix(now) - prefix(it->second + 1);
+            hist[(size_t)(dist / rate)] += 1;
+            add(it->second, -1);
+            marks[it->second] = false;
+            it->second = now;
+        }
+        add(now, 1);
+        marks[now] = true;
+        now += 1;
+    }
+
+    // Print the curve at power-of-2 sizes (in lines) up to the largest
+    // reuse distance, and at `size`. A miss beyond the first `size` fills
+    // is predicted to evict (conflict with) a resident line.
+    void log(std::ostream &os, size_t size) {
+        if (!enabled() || sampled == 0)
+            return;
+        std::set<size_t> sizes{size};
+        size_t max_dist = hist.empty() ? 1 : hist.rbegin()->first + 1;
+        for (size_t s = 1; s <= max_dist * 2; s *= 2)
+            sizes.insert(s);
+        os << " * Miss ratio curve (sample rate " << rate << ", "
+           << (size_t)sampled << " of " << (size_t)total
+           << " accesses): " << std::endl;
+        os << "   size,miss_ratio,predicted_evictions" << std::endl;
+        // Accesses with distance >= s miss in a cache of s lines.
+        double beyond = sampled - cold;
+        auto it = hist.begin();
+        for (auto s : sizes) {
+            for (; it != hist.end() && it->first < s; ++it)
+                beyond -= it->second;
+            auto ratio = (cold + beyond) / sampled;
+            auto misses = ratio * total;
+            auto evictions = misses > s ? misses - s : 0;
+            os << "   " << s << "," << ratio << "," << evictions << std::endl;
+        }
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_MRC_PROFILER_HH
@@ -0,0 +1,116 @@
+#pragma once
+#ifndef XERXES_PARALLEL_CLOCK_HH
+#define XERXES_PARALLEL_CLOCK_HH
+
+#include "dramsim3_interface.hh"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace xerxes {
+// Clocks DRAMsim3 endpoints to the current tick after each event. Each
+// DRAMsim3 memory system is independent, so with more than one thread the
+// memories are clocked in parallel. Their responses are held meanwhile,
+// and sent in memory order once all memories are done, so the results do
+// not depend on the thread count.
+class ParallelClock {
+    std::vector<DRAMsim3Interface *> mems;
+    std::vector<Tick> mems_tick;
+    int clock_granu;
+
+    std::vector<std::thread> workers;
+    // Bumped to start a round, workers then take memories by `next`.
+    std::atomic<uint64_t> round{0};
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::atomic<bool> stopping{false};
+    Tick target = 0;
+    bool repeat = false;
+
+    void clock_one(size_t i) {
+        mems_tick[i] = 0;
+        for (int g = 0; g < clock_granu && (mems_tick[i] < target || repeat);
+             ++g)
+            mems_tick[i] = mems[i]->clock();
+    }
+
+    void work() {
+        size_t i;
+        while ((i = next.fetch_add(1, std::memory_order_acq_rel)) <
+               mems.size()) {
+            clock_one(i);
+            done.fetch_add(1, std::memory_order_release);
+        }
+    }
+
+    // Rounds follow each other closely, so wait by spinning first.
+    template <typename F> static void spin_until(F cond) {
+        for (size_t n = 0; !cond(); ++n)
+            if (n >= 1024)
+                std::this_thread::yield();
+    }
+
+    void worker() {
+        uint64_t seen = 0;
+        while (true) {
+            spin_until([&] {
+                return round.load(std::memory_order_acquire) != seen ||
+                       stopping.load(std::memory_order_acquire);
+            });
+            if (stopping.load(std::memory_order_acquire))
+                return;
+            seen = round.load(std::memory_order_acquire);
+            work();
+        }
+    }
+
+  public:
+    // `threads` includes the calling thread, 0 for the hardware concurrency.
+    // Spinning threads would only slow each other down beyond it.
+    ParallelClock(const std::vector<DRAMsim3Interface *> &mems, int threads,
+                  int clock_granu)
+        : mems(mems), mems_tick(mems.size(), 0), clock_granu(clock_granu) {
+        size_t hw = std::thread::hardware_concurrency();
+        size_t n = threads > 0 ? threads : hw;
+        if (hw > 0)
+            n = std::min(n, hw);
+        n = std::min(n, mems.size());
+        for (size_t t = 1; t < n; ++t)
+            workers.emplace_back([this] { worker(); });
+    }
+
+    ~ParallelClock() {
+        stopping.store(true, std::memory_order_release);
+        for (auto &w : workers)
+            w.join();
+    }
+
+    // Synchronize all memories to `tick`. A repeated tick clocks them once
+    // more, as the events of the tick may have issued to them.
+    void clock_to(Tick tick, bool not_changed) {
+        target = tick;
+        repeat = not_changed;
+        if (workers.empty()) {
+            for (size_t i = 0; i < mems.size(); ++i)
+                clock_one(i);
+            return;
+        }
+        for (auto mem : mems)
+            mem->hold_responses();
+        // A worker late from the last round may take memories as soon as
+        // `next` is reset.
+        done.store(0, std::memory_order_relaxed);
+        next.store(0, std::memory_order_release);
+        round.fetch_add(1, std::memory_order_release);
+        work();
+        spin_until([&] {
+            return done.load(std::memory_order_acquire) == mems.size();
+        });
+        for (auto mem : mems)
+            mem->release_responses();
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_PARALLEL_CLOCK_HH
@@ -3,21 +3,84 @@
 #define XERXES_REQUESTER_HH
 
 #include "device.hh"
+#include "hdm_decoder.hh"
+#include "host_cache.hh"
+#include "host_prefetcher.hh"
+#include "mrc_profiler.hh"
+#include "trace_reader.hh"
 #include "utils.hh"
 
 #include <algorithm>
 #include <cmath>
-#include <fstream>
-#include <list>
+#include <deque>
+#include <map>
+#include <numeric>
 #include <random>
 #include <set>
-#include <unordered_set>
+
+namespace xerxes {
+// Parameters of the synthetic request generators.
+struct SyntheticConfig {
+    // "zipf": skew of the block popularity.
+    double zipf_theta = 0.99;
+    // "strided": parallel streams per endpoint, and their stride in bytes.
+    size_t stream_num = 1;
+    size_t stride = 64;
+    // "chase": size of the pointer chain per endpoint, in bytes.
+    size_t chase_footprint = 1 << 24;
+    // Read/write phases: the write ratio steps through phase_wr_ratios
+    // every phase_length requests. 0 disables, and the write ratio of each
+    // memory is used.
+    size_t phase_length = 0;
+    std::vector<double> phase_wr_ratios;
+    // "mix": generators to pick each request from, by weight.
+    std::vector<std::string> mix_types;
+    std::vector<double> mix_weights;
+};
+} // namespace xerxes
+
+TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::SyntheticConfig, zipf_theta,
+                                       stream_num, stride, chase_footprint,
+                                       phase_length, phase_wr_ratios,
+                                       mix_types, mix_weights);
+
+namespace xerxes {
+// Open-loop injection, for latency-vs-load curves.
+struct LoadConfig {
+    // "closed": issue whenever the issue queue allows (the default).
+    // "constant" or "poisson": inject at `rate` GB/s with constant or
+    // exponential intervals, regardless of the outstanding requests.
+    std::string mode = "closed";
+    double rate = 1;
+    // Outstanding requests before injection stalls, 0 for no limit.
+    size_t max_outstanding = 0;
+    // Sweep the offered load through these rates (GB/s) in one run. Each
+    // step lasts `warmup` + `window` ticks and is measured in the window
+    // only. Empty: inject at `rate` until the requests run out.
+    std::vector<double> sweep_rates;
+    Tick warmup = 10000;
+    Tick window = 100000;
+};
+} // namespace xerxes
+
+TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::LoadConfig, mode, rate,
+                                       max_outstanding, sweep_rates, warmup,
+                                       window);
 
 namespace xerxes {
 class RequesterConfig {
   public:
     size_t q_capacity = 32;
+    // Host caches, capacities in lines. The LLC (cache_*) is shared, and
+    // the optional private L1/L2 (capacity 0 disables) are inclusive in it.
+    size_t l1_capacity = 0;
+    size_t l1_assoc = 8;
+    Tick l1_delay = 4;
+    size_t l2_capacity = 0;
+    size_t l2_assoc = 8;
+    Tick l2_delay = 8;
     size_t cache_capacity = 8192;
+    size_t cache_assoc = 16;
     Tick cache_delay = 12;
     Tick issue_delay = 0;
     bool coherent = false;
@@ -28,15 +91,47 @@ class RequesterConfig {
     double hot_req_ratio = 0.5;
     double hot_region_ratio = 0.5;
     std::string trace_file = "";
+    // "text", "binary" (see trace_format.hh) or "auto" to detect.
+    std::string trace_format = "auto";
+    // HDM decoders mapping host addresses to memories. Without decoders,
+    // requests go to each memory in turn, within the memory's own range.
+    std::vector<HDMDecoderConfig> decoders;
+    // Seed of the request generators, 0 to draw one from the random device.
+    // Each requester mixes in its own id.
+    uint64_t seed = 1;
+    SyntheticConfig synthetic;
+    LoadConfig load;
+    // Prefetcher in front of the host cache (coherent only).
+    PrefetchConfig prefetch;
+    // Sample rate of the cache miss ratio curve profiler, 0 disables.
+    double mrc_sample_rate = 0;
+    // Out-of-order core model, enabled by a non-zero rob_size. Each of the
+    // `cores` cores dispatches `inst_rate` instructions per tick, with
+    // `inst_gap` non-memory instructions before each request (unless the
+    // trace gives one). A core stalls when its oldest outstanding miss is
+    // `rob_size` instructions behind, when `mshr_size` misses are
+    // outstanding (0: no limit but q_capacity), or when a dependent load
+    // waits for the previous load.
+    size_t cores = 1;
+    size_t rob_size = 0;
+    size_t mshr_size = 0;
+    size_t inst_gap = 0;
+    double inst_rate = 4;
 };
 } // namespace xerxes
 
 TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::RequesterConfig, q_capacity,
-                                       cache_capacity, cache_delay, issue_delay,
+                                       l1_capacity, l1_assoc, l1_delay,
+                                       l2_capacity, l2_assoc, l2_delay,
+                                       cache_capacity, cache_assoc, cache_delay,
+                                       issue_delay,
                                        coherent, burst_size, block_size,
                                        interleave_type, interleave_param,
                                        hot_req_ratio, hot_region_ratio,
-                                       trace_file);
+                                       trace_file, trace_format, decoders,
+                                       seed, synthetic, load, prefetch,
+                                       mrc_sample_rate, cores, rob_size,
+                                       mshr_size, inst_gap, inst_rate);
 
 namespace xerxes {
 class Requester : public Device {
@@ -53,6 +148,12 @@ class Requester : public Device {
             Addr addr;
             Tick tick;
             bool is_write;
+            // Non-memory instructions before this request, 0 for default.
+            size_t gap = 0;
+            // Depends on the data of the previous load.
+            bool dep = false;
+            // Core issuing the request, -1 for any.
+            int32_t core = -1;
         };
 
         struct EndPoint {
@@ -73,56 +174,35 @@ class Requester : public Device {
             gen.seed(rd());
             uni = std::uniform_real_distribution<>(0, 1);
         }
+        virtual ~Interleaving() {}
         size_t size() { return end_points.size(); }
-        void push_back(EndPoint ep) {
+        virtual void push_back(EndPoint ep) {
             ep.cur = ep.start;
             end_points.push_back(ep);
         }
+        virtual void seed(uint64_t value) { gen.seed(value); }
 
         virtual Request next() = 0;
         virtual bool eof() = 0;
     };
 
     class Trace : public Interleaving {
-      public:
-        struct TraceReq {
-            Addr addr;
-            bool is_write;
-            Tick tick;
-        };
-
-      private:
-        std::ifstream trace_file;
-        std::function<TraceReq(std::ifstream &)> decoder;
+        TraceReader reader;
 
       public:
-        Trace(
-            std::string trace_file,
-            std::function<TraceReq(std::ifstream &)> decoder =
-                [](std::ifstream &file) {
-                    static std::unordered_set<std::string> write_types = {
-                        "W", "WR", "WRITE", "write", "P_MEM_WR", "BOFF"};
-                    std::string type;
-                    Addr addr;
-                    Tick tick;
-                    file >> std::hex >> addr >> std::dec >> type >> tick;
-                    return TraceReq{addr, write_types.count(type) > 0, tick};
-                },
-            size_t block_size = 64)
-            : Interleaving(block_size), decoder(decoder) {
-            this->trace_file.open(trace_file);
-            ASSERT(this->trace_file.is_open(),
-                   std::string{"Cannot open trace file"} + trace_file);
-        }
-        bool eof() { return trace_file.eof(); }
+        Trace(std::string trace_file, std::string format = "auto",
+              size_t block_size = 64)
+            : Interleaving(block_size), reader(trace_file, format) {}
+        bool eof() { return reader.eof(); }
         Request next() {
-            // TODO: flexible trace decoding
-            auto req = decoder(trace_file);
+            TraceReader::Record req;
+            reader.next(req);
             auto ep = end_points[cur].id;
             req.addr =
                 (req.addr % end_points[cur].capacity) + end_points[cur].start;
             cur = (cur + 1) % end_points.size();
-            return {ep, req.addr, req.tick, req.is_write};
+            return {ep, req.addr, req.tick, req.is_write, req.gap, req.dep,
+                    req.core};
         }
     };
 
@@ -184,9 +264,9 @@ class Requester : public Device {
             norm = std::normal_distribution<>(0.5, 0.5);
         }
 
-        void finalize_endpoint(size_t idx) {
-            ASSERT(idx < end_points.size(), "Endpoint index out of range");
-            configure_hot_region(end_points[idx]);
+        void push_back(EndPoint ep) override {
+            Interleaving::push_back(ep);
+            configure_hot_region(end_points.back());
         }
         bool eof() { return cur_count == total_count; }
         Request next() {
@@ -230,32 +310,249 @@ class Requester : public Device {
         }
     };
 
-    class FakeLRUCache {
-        std::list<Addr> cache;
+    // Base of the synthetic generators: a request count, and read/write
+    // phases overriding the write ratio of the endpoints.
+    class Synthetic : public Interleaving {
+      protected:
+        size_t total_count;
+        size_t cur_count = 0;
+        size_t phase_length;
+        std::vector<double> phase_ratios;
+
+        bool phased() { return phase_length > 0 && !phase_ratios.empty(); }
+        // Write ratio of the current phase.
+        double phase_ratio() {
+            return phase_ratios[cur_count / phase_length % phase_ratios.size()];
+        }
+
+        // Decide the type of the next request, then count it.
+        bool take_write(const EndPoint &ep) {
+            auto ratio = phased() ? phase_ratio() : ep.ratio;
+            cur_count++;
+            return uni(gen) < ratio;
+        }
+
+        // The endpoint of the next request, in turn.
+        size_t take_endpoint() {
+            auto i = cur;
+            cur = (cur + 1) % end_points.size();
+            return i;
+        }
 
       public:
-        size_t capacity;
-        Tick delay;
-        FakeLRUCache(size_t capacity, Tick delay)
-            : capacity(capacity), delay(delay) {}
-        void insert(Addr addr) {
-            if (cache.size() >= capacity)
-                cache.pop_front();
-            cache.push_back(addr);
-        }
-        bool hit(Addr addr) {
-            auto it = std::find(cache.begin(), cache.end(), addr);
-            if (it != cache.end()) {
-                cache.erase(it);
-                cache.push_back(addr);
-                return true;
+        Synthetic(const RequesterConfig &config)
+            : Interleaving(config.block_size),
+              total_count(config.interleave_param),
+              phase_length(config.synthetic.phase_length),
+              phase_ratios(config.synthetic.phase_wr_ratios) {}
+        bool eof() { return cur_count == total_count; }
+    };
+
+    // Zipfian block popularity over each endpoint, with skew theta. Ranks
+    // are drawn by rejection-inversion (Hormann and Derflinger), in O(1)
+    // per request for any number of blocks, and scattered over the blocks
+    // by a fixed permutation so that hot blocks are not adjacent.
+    class Zipf : public Synthetic {
+        struct Sampler {
+            uint64_t n;
+            uint64_t scatter;
+            double h_x1, h_n, s;
+        };
+        double theta;
+        std::vector<Sampler> samplers;
+
+        static double helper1(double x) {
+            return std::abs(x) > 1e-8
+                       ? std::log1p(x) / x
+                       : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+        }
+        static double helper2(double x) {
+            return std::abs(x) > 1e-8
+                       ? std::expm1(x) / x
+                       : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+        }
+        double h(double x) { return std::exp(-theta * std::log(x)); }
+        double h_integral(double x) {
+            auto log_x = std::log(x);
+            return helper2((1 - theta) * log_x) * log_x;
+        }
+        double h_integral_inverse(double x) {
+            auto t = std::max(-1.0, x * (1 - theta));
+            return std::exp(helper1(t) * x);
+        }
+
+        // A rank in [1, n].
+        uint64_t sample(const Sampler &z) {
+            while (true) {
+                auto u = z.h_n + uni(gen) * (z.h_x1 - z.h_n);
+                auto x = h_integral_inverse(u);
+                auto k =
+                    (uint64_t)std::max(1.0, std::min(x + 0.5, (double)z.n));
+                if (k - x <= z.s || u >= h_integral(k + 0.5) - h(k))
+                    return k;
             }
-            return false;
         }
-        void invalidate(Addr addr) {
-            auto it = std::find(cache.begin(), cache.end(), addr);
-            if (it != cache.end())
-                cache.erase(it);
+
+      public:
+        Zipf(const RequesterConfig &config)
+            : Synthetic(config), theta(config.synthetic.zipf_theta) {
+            ASSERT(theta >= 0, "zipf: theta should not be negative");
+        }
+
+        void push_back(EndPoint ep) override {
+            Interleaving::push_back(ep);
+            Sampler z;
+            z.n = std::max<uint64_t>(1, ep.capacity / block_size);
+            // A multiplier coprime to n permutes the blocks.
+            z.scatter = 0x9e3779b97f4a7c15ULL % z.n;
+            while (std::gcd(z.scatter, z.n) != 1)
+                z.scatter += 1;
+            z.h_x1 = h_integral(1.5) - 1;
+            z.h_n = h_integral(z.n + 0.5);
+            z.s = 2 - h_integral_inverse(h_integral(2.5) - h(2));
+            samplers.push_back(z);
+        }
+
+        Request next() {
+            auto i = take_endpoint();
+            auto &ep = end_points[i];
+            auto &z = samplers[i];
+            auto rank = sample(z) - 1;
+            auto block = (uint64_t)((unsigned __int128)rank * z.scatter % z.n);
+            bool is_write = take_write(ep);
+            return {ep.id, ep.start + block * block_size, 0, is_write};
+        }
+    };
+
+    // `stream_num` sequential streams per endpoint, each striding over its
+    // own slice of the endpoint, and taking turns.
+    class Strided : public Synthetic {
+        struct Streams {
+            size_t slice;
+            size_t next = 0;
+            std::vector<Addr> offsets;
+        };
+        size_t stream_num;
+        size_t stride;
+        std::vector<Streams> streams;
+
+      public:
+        Strided(const RequesterConfig &config)
+            : Synthetic(config), stream_num(config.synthetic.stream_num),
+              stride(config.synthetic.stride) {
+            ASSERT(stream_num > 0, "strided: stream_num should be positive");
+            ASSERT(stride > 0, "strided: stride should be positive");
+        }
+
+        void push_back(EndPoint ep) override {
+            Interleaving::push_back(ep);
+            Streams st;
+            st.slice = ep.capacity / stream_num / block_size * block_size;
+            ASSERT(st.slice > 0, "strided: endpoint is too small");
+            st.offsets.resize(stream_num, 0);
+            streams.push_back(st);
+        }
+
+        Request next() {
+            auto i = take_endpoint();
+            auto &ep = end_points[i];
+            auto &st = streams[i];
+            auto s = st.next;
+            st.next = (st.next + 1) % stream_num;
+            auto addr = ep.start + s * st.slice + st.offsets[s];
+            st.offsets[s] = (st.offsets[s] + stride) % st.slice;
+            bool is_write = take_write(ep);
+            return {ep.id, addr, 0, is_write};
+        }
+    };
+
+    // Pointer chasing: each endpoint holds one random cyclic chain over the
+    // blocks of its first `chase_footprint` bytes, and every load depends
+    // on the previous one, so requests see the unloaded latency.
+    class Chase : public Synthetic {
+        size_t footprint;
+        std::vector<std::vector<uint32_t>> chains;
+        std::vector<uint32_t> pos;
+
+      public:
+        Chase(const RequesterConfig &config)
+            : Synthetic(config),
+              footprint(config.synthetic.chase_footprint) {}
+
+        void push_back(EndPoint ep) override {
+            Interleaving::push_back(ep);
+            auto n = std::min(footprint, ep.capacity) / block_size;
+            ASSERT(n > 0 && n <= UINT32_MAX, "chase: bad footprint");
+            // Sattolo's algorithm, a random permutation of a single cycle.
+            std::vector<uint32_t> chain(n);
+            for (size_t j = 0; j < n; ++j)
+                chain[j] = j;
+            for (size_t j = n - 1; j > 0; --j) {
+                std::uniform_int_distribution<size_t> dist(0, j - 1);
+                std::swap(chain[j], chain[dist(gen)]);
+            }
+            chains.push_back(std::move(chain));
+            pos.push_back(0);
+        }
+
+        Request next() {
+            auto i = take_endpoint();
+            auto &ep = end_points[i];
+            auto addr = ep.start + (Addr)pos[i] * block_size;
+            pos[i] = chains[i][pos[i]];
+            cur_count++;
+            return {ep.id, addr, 0, false, 0, true};
+        }
+    };
+
+    // Each request is taken from one of the generators, by weight. The
+    // phases, if any, apply to all requests.
+    class Mix : public Synthetic {
+        std::vector<Interleaving *> parts;
+        std::vector<double> weights;
+
+      public:
+        Mix(const RequesterConfig &config, std::vector<Interleaving *> parts)
+            : Synthetic(config), parts(parts),
+              weights(config.synthetic.mix_weights) {
+            ASSERT(!parts.empty() && weights.size() == parts.size(),
+                   "mix: mix_types and mix_weights should match");
+            double sum = 0;
+            for (auto &w : weights) {
+                ASSERT(w >= 0, "mix: negative weight");
+                sum += w;
+                w = sum;
+            }
+            ASSERT(sum > 0, "mix: weights sum to 0");
+            for (auto &w : weights)
+                w /= sum;
+        }
+        ~Mix() {
+            for (auto part : parts)
+                delete part;
+        }
+
+        void push_back(EndPoint ep) override {
+            Interleaving::push_back(ep);
+            for (auto part : parts)
+                part->push_back(ep);
+        }
+        void seed(uint64_t value) override {
+            Interleaving::seed(value);
+            for (auto part : parts)
+                part->seed(gen());
+        }
+
+        Request next() {
+            auto u = uni(gen);
+            size_t i = 0;
+            while (i + 1 < parts.size() && u >= weights[i])
+                ++i;
+            auto req = parts[i]->next();
+            if (phased())
+                req.is_write = uni(gen) < phase_ratio();
+            cur_count++;
+            return req;
         }
     };
 
@@ -279,55 +576,220 @@ class Requester : public Device {
         void pop(const Packet &pkt) { queue.erase(pkt.id); }
     };
 
+    // Requests read ahead for each core at most.
+    static constexpr size_t MAX_BACKLOG = 4096;
+
+    // A core of the out-of-order model.
+    struct Core {
+        enum Stall { ROB, MSHR, DEP, STALL_NUM };
+
+        Tick cur = 0;
+        double frac = 0; // Dispatch time below one tick.
+        size_t seq = 0;  // Dispatched instructions.
+        // Non-memory instructions before the pending request, not dispatched
+        // yet.
+        size_t gap = 0;
+        // Outstanding misses, by instruction sequence number.
+        std::map<size_t, PktID> inflight;
+        size_t last_load = 0;
+        bool has_pending = false;
+        Interleaving::Request pending;
+        // Requests read ahead for this core, when the trace gives core ids.
+        std::deque<Interleaving::Request> backlog;
+        // Waiting for a full backlog of another core to drain.
+        bool starved = false;
+        bool stalled = false;
+        Stall reason = ROB;
+        Tick stall_since = 0;
+        size_t stalled_seq = (size_t)-1; // Last stalled request.
+        double stall_count[STALL_NUM] = {};
+        double stall_time[STALL_NUM] = {};
+    };
+
     Interleaving *end_points;
+    std::vector<HDMDecoderConfig> decoder_configs;
+    AddressMap map;
     IssueQueue q;
-    FakeLRUCache cache;
+    CacheHierarchy cache;
+    MRCProfiler mrc;
+    Prefetcher *prefetcher;
+    std::string prefetch_type;
+    // Outstanding prefetch -> core to fill.
+    std::unordered_map<PktID, size_t> prefetches;
+    // Lines the last access asked to prefetch, from a core at a tick.
+    std::vector<Addr> pf_lines;
+    size_t pf_core = 0;
+    Tick pf_tick = 0;
     Tick cur = 0;
     Tick last_arrive = 0;
     size_t cur_cnt = 0;
+    size_t prefetch_cnt = 0;
     Tick issue_delay;
     bool coherent;
     size_t burst_size = 1;
     size_t block_size = 64;
+    // Issue events stopped, until a response arrives.
+    bool idle = false;
+    // A dependent request waiting for the outstanding ones (no core model).
+    bool has_held = false;
+    Interleaving::Request held;
+
+    std::vector<Core> cores;
+    size_t rob_size;
+    size_t mshr_size;
+    size_t inst_gap;
+    double inst_rate;
+    // Outstanding miss -> (core, sequence number).
+    std::unordered_map<PktID, std::pair<size_t, size_t>> owner;
+    // Requests issued by the current issue event, not sent yet.
+    std::vector<Packet> batch;
+
+    // Requests and latency measured in a sweep step, per endpoint.
+    struct LoadPoint {
+        double count = 0;
+        double latency = 0;
+        double bytes = 0;
+    };
+    LoadConfig load;
+    bool open_loop;
+    bool poisson;
+    std::mt19937_64 load_gen;
+    double load_frac = 0; // Injection interval below one tick.
+    // Injection waits for an outstanding request to complete.
+    bool blocked = false;
+    // Tick of the last injection, later requests wait behind it.
+    Tick injected_at = 0;
+    // The sweep is over, no more requests.
+    bool stopped = false;
+    // Intended injection tick of the outstanding requests. Latency is
+    // measured from it, so waiting to be injected counts.
+    std::unordered_map<PktID, Tick> injected;
+    std::vector<std::map<TopoID, LoadPoint>> curve;
 
     std::unordered_map<TopoID, std::unordered_map<std::string, double>> stats;
 
   public:
     Requester(Simulation *sim, const RequesterConfig &config,
               std::string name = "Host")
-        : Device(sim, name), q(config.q_capacity),
-          cache(config.cache_capacity, config.cache_delay),
-          issue_delay(config.issue_delay), coherent(config.coherent),
-          burst_size(config.burst_size), block_size(config.block_size) {
+        : Device(sim, name), decoder_configs(config.decoders),
+          q(config.load.mode == "closed" ? config.q_capacity
+            : config.load.max_outstanding > 0 ? config.load.max_outstanding
+                                              : SIZE_MAX),
+          cache(config.cores, config.block_size,
+                CacheLevel(config.l1_capacity, config.l1_assoc,
+                           config.l1_delay),
+                CacheLevel(config.l2_capacity, config.l2_assoc,
+                           config.l2_delay),
+                CacheLevel(config.cache_capacity, config.cache_assoc,
+                           config.cache_delay)),
+          mrc(config.mrc_sample_rate),
+          prefetcher(Prefetcher::make(config.prefetch)),
+          prefetch_type(config.prefetch.type), issue_delay(config.issue_delay),
+          coherent(config.coherent),
+          burst_size(config.burst_size), block_size(config.block_size),
+          cores(config.cores), rob_size(config.rob_size),
+          mshr_size(config.mshr_size), inst_gap(config.inst_gap),
+          inst_rate(config.inst_rate), load(config.load),
+          open_loop(config.load.mode != "closed"),
+          poisson(config.load.mode == "poisson") {
+        ASSERT(config.cores > 0, name + ": no core");
+        ASSERT(config.cores == 1 || rob_size > 0,
+               name + ": multiple cores need the core model (rob_size > 0)");
+        ASSERT(inst_rate > 0, name + ": inst_rate should be positive");
+        ASSERT(prefetcher == nullptr || coherent,
+               name + ": prefetching needs the host cache (coherent)");
         XerxesLogger::debug()
             << "Interleave param " << config.interleave_param << std::endl;
-        if (config.interleave_type == "stream") {
-            end_points = new Stream{config.interleave_param};
-        } else if (config.interleave_type == "random") {
-            end_points =
-                new Random{config.interleave_param, block_size, 0.5, 0.5};
-        } else if (config.interleave_type == "hotcold") {
-            end_points =
-                new Random{config.interleave_param, block_size,
-                           config.hot_req_ratio, config.hot_region_ratio};
-        } else if (config.interleave_type == "trace") {
-            end_points = new Trace{config.trace_file};
-        } else {
-            PANIC("Unknown interleave type: " + config.interleave_type);
+        end_points = make_interleaving(config.interleave_type, config);
+        if (config.seed != 0)
+            end_points->seed(config.seed + self * 0x9e3779b97f4a7c15ULL);
+        if (open_loop) {
+            ASSERT(poisson || load.mode == "constant",
+                   name + ": unknown load mode " + load.mode);
+            ASSERT(rob_size == 0,
+                   name + ": open-loop injection replaces the core model");
+            ASSERT(load.window > 0, name + ": load window should be positive");
+            ASSERT(!load.sweep_rates.empty() || load.rate > 0,
+                   name + ": load rate should be positive");
+            for (auto rate : load.sweep_rates)
+                ASSERT(rate > 0, name + ": sweep rates should be positive");
+            load_gen.seed(config.seed != 0 ? config.seed + self
+                                           : std::random_device{}());
+            curve.resize(std::max<size_t>(load.sweep_rates.size(), 1));
+        }
+    }
+
+    static Interleaving *make_interleaving(const std::string &type,
+                                           const RequesterConfig &config) {
+        if (type == "stream") {
+            return new Stream{config.interleave_param};
+        } else if (type == "random") {
+            return new Random{config.interleave_param, config.block_size, 0.5,
+                              0.5};
+        } else if (type == "hotcold") {
+            return new Random{config.interleave_param, config.block_size,
+                              config.hot_req_ratio, config.hot_region_ratio};
+        } else if (type == "trace") {
+            return new Trace{config.trace_file, config.trace_format};
+        } else if (type == "zipf") {
+            return new Zipf{config};
+        } else if (type == "strided") {
+            return new Strided{config};
+        } else if (type == "chase") {
+            return new Chase{config};
+        } else if (type == "mix") {
+            // The parts generate requests for as long as the mix does.
+            auto part_config = config;
+            part_config.interleave_param = SIZE_MAX;
+            part_config.synthetic.phase_length = 0;
+            std::vector<Interleaving *> parts;
+            for (auto &part : config.synthetic.mix_types) {
+                ASSERT(part != "mix" && part != "trace",
+                       "Cannot mix interleave type " + part);
+                parts.push_back(make_interleaving(part, part_config));
+            }
+            return new Mix{config, parts};
         }
+        PANIC("Unknown interleave type: " + type);
+        return nullptr;
+    }
+
+    ~Requester() {
+        delete end_points;
+        delete prefetcher;
     }
 
     Requester &add_end_point(TopoID id, Addr start, size_t capacity,
                              double ratio) {
         end_points->push_back({id, start, capacity, ratio});
-        if (auto rnd = dynamic_cast<Random *>(end_points))
-            rnd->finalize_endpoint(end_points->size() - 1);
+        init_stats(id);
+        return *this;
+    }
+
+    const std::vector<HDMDecoderConfig> &decoders() const {
+        return decoder_configs;
+    }
+
+    // Route requests through HDM decoders. Requests are generated over the
+    // decoded space as if it were one endpoint, and each goes to the memory
+    // its host address decodes to.
+    Requester &set_address_map(const AddressMap &address_map, double ratio) {
+        map = address_map;
+        end_points->push_back({-1, 0, map.capacity(), ratio});
+        for (auto &decoder : map.list())
+            for (auto id : decoder.target_list())
+                init_stats(id);
+        return *this;
+    }
+
+    void init_stats(TopoID id) {
         stats[id] = {};
         stats[id]["Count"] = 0;
         stats[id]["Bandwidth"] = 0;
         stats[id]["Average latency"] = 0;
         stats[-1]["Cache evict count"] = 0;
         stats[-1]["Cache hit count"] = 0;
+        stats[-1]["Dirty evict count"] = 0;
         // stats[id]["Average switch queuing"] = 0;
         // stats[id]["Average switch time"] = 0;
         stats[id]["Average wait for evict"] = 0;
@@ -336,7 +798,6 @@ class Requester : public Device {
         // stats[id]["Average wait on bus"] = 0;
         // stats[id]["Average wait for packaging"] = 0;
         // stats[id]["Average wait burst"] = 0;
-        return *this;
     }
 
     void transit() override {
@@ -348,31 +809,54 @@ class Requester : public Device {
                     << name() << " receive packet " << pkt.id
                     << ", issue queue is full? " << q.full() << std::endl;
                 last_arrive = pkt.arrive;
-                if (coherent)
-                    cache.insert(pkt.addr);
-
-                // Update stats
-                stats[pkt.src]["Count"] += 1;
-                stats[pkt.src]["Bandwidth"] += pkt.burst * 64;
-                stats[pkt.src]["Average latency"] += pkt.arrive - pkt.sent;
-                stats[pkt.src]["Average wait for evict"] +=
-                    pkt.get_stat(SNOOP_EVICT_DELAY);
-
-                // Queue is previously full so issue event is not registered,
-                // now we can register it.
-                if (q.full())
+                // Prefetches are not requests of the workload, so they are
+                // kept out of its stats and of the per-request log.
+                bool prefetch = fill_prefetch(pkt);
+                if (!prefetch) {
+                    if (coherent)
+                        cache.fill(core_of(pkt), pkt.addr, pkt.is_write());
+
+                    // Update stats
+                    stats[pkt.src]["Count"] += 1;
+                    stats[pkt.src]["Bandwidth"] += pkt.burst * 64;
+                    stats[pkt.src]["Average latency"] +=
+                        pkt.arrive - pkt.sent;
+                    stats[pkt.src]["Average wait for evict"] +=
+                        pkt.get_stat(SNOOP_EVICT_DELAY);
+                    auto it = injected.find(pkt.id);
+                    if (it != injected.end()) {
+                        record_load(pkt.src, it->second, pkt.arrive,
+                                    pkt.burst * 64);
+                        injected.erase(it);
+                    }
+                }
+
+                // Issue events stopped (queue full or cores stalled), now we
+                // can register it.
+                if (idle) {
+                    idle = false;
                     register_issue_event(pkt.arrive);
+                }
                 q.pop(pkt);
-                pkt.log_stat();
+                retire(pkt);
+                if (!prefetch)
+                    pkt.log_stat();
             } else if (pkt.type == INV) {
                 if (coherent) {
-                    cache.invalidate(pkt.addr);
+                    // Invalidate every line of the burst, only dirty lines
+                    // are returned with the response.
+                    size_t dirty_cnt = 0;
+                    for (size_t i = 0; i < pkt.burst; ++i)
+                        dirty_cnt +=
+                            cache.invalidate(pkt.addr + i * block_size);
                     stats[-1]["Cache evict count"] += 1;
+                    stats[-1]["Dirty evict count"] += dirty_cnt;
                     std::swap(pkt.src, pkt.dst);
                     pkt.is_rsp = true;
-                    pkt.payload = block_size * pkt.burst;
-                    pkt.arrive += cache.delay; // TODO: one or each?
-                    pkt.delta_stat(NormalStatType::HOST_INV_DELAY, cache.delay);
+                    pkt.payload = block_size * dirty_cnt;
+                    pkt.arrive += cache.inv_delay(); // TODO: one or each?
+                    pkt.delta_stat(NormalStatType::HOST_INV_DELAY,
+                                   cache.inv_delay());
                     cur = std::max(cur, pkt.arrive) + issue_delay;
                     send_pkt(pkt);
                 }
@@ -410,8 +894,31 @@ class Requester : public Device {
         os << name() << " stats: " << std::endl;
         os << " * Payload size: " << block_size << " bytes" << std::endl;
         os << " * Issued packets: " << cur_cnt << std::endl;
+        if (prefetcher != nullptr)
+            os << " * Issued prefetches: " << prefetch_cnt << std::endl;
         os << " * Evict count: " << stats[-1]["Cache evict count"] << std::endl;
         os << " * Hit count: " << stats[-1]["Cache hit count"] << std::endl;
+        os << " * Dirty evict count: " << stats[-1]["Dirty evict count"]
+           << std::endl;
+        cache.log_stats(os);
+        if (prefetcher != nullptr)
+            prefetcher->log_stats(os, prefetch_type, burst_size * 64,
+                                  last_arrive);
+        mrc.log(os, cache.capacity());
+        for (size_t i = 0; rob_size > 0 && i < cores.size(); ++i) {
+            auto &core = cores[i];
+            os << " * Core " << i << ": " << std::endl;
+            os << "   - Instructions: " << core.seq << std::endl;
+            os << "   - IPC (per ns): "
+               << (core.cur > 0 ? core.seq / (double)core.cur : 0)
+               << std::endl;
+            const char *reasons[] = {"ROB", "MSHR", "dependency"};
+            for (size_t r = 0; r < Core::STALL_NUM; ++r) {
+                os << "   - " << reasons[r]
+                   << " stall count/time (ns): " << core.stall_count[r] << "/"
+                   << core.stall_time[r] << std::endl;
+            }
+        }
         double agg_bw = 0;
         double agg_cnt = 0;
         double agg_lat = 0;
@@ -440,19 +947,360 @@ class Requester : public Device {
         os << "   - Average latency (ns): " << agg_lat / agg_cnt << std::endl;
         os << "   - Average wait for evict (ns): " << agg_wait / agg_cnt
            << std::endl;
+        if (open_loop)
+            log_curve(os);
     }
 
-    bool step(bool coherent) {
+    // The latency-vs-load curve, a line per step and endpoint.
+    void log_curve(std::ostream &os) {
+        os << " * Load curve (offered GB/s, endpoint, bandwidth GB/s, "
+              "latency ns): "
+           << std::endl;
+        for (size_t s = 0; s < curve.size(); ++s) {
+            double offered = load.rate;
+            // Without a sweep, measured from the warmup to the last response.
+            double window = last_arrive > load.warmup
+                                ? (double)(last_arrive - load.warmup)
+                                : 1;
+            if (!load.sweep_rates.empty()) {
+                offered = load.sweep_rates[s];
+                window = load.window;
+            }
+            LoadPoint all;
+            for (auto &pair : curve[s]) {
+                auto &p = pair.second;
+                os << "   - " << offered << ", " << pair.first << ", "
+                   << p.bytes / window << ", "
+                   << (p.count > 0 ? p.latency / p.count : 0) << std::endl;
+                all.count += p.count;
+                all.latency += p.latency;
+                all.bytes += p.bytes;
+            }
+            os << "   - " << offered << ", all, " << all.bytes / window << ", "
+               << (all.count > 0 ? all.latency / all.count : 0) << std::endl;
+        }
+    }
+
+    size_t core_of(const Packet &pkt) {
+        auto it = owner.find(pkt.id);
+        return it == owner.end() ? 0 : it->second.first;
+    }
+
+    // A miss of the core model completed, wake up its core.
+    void retire(const Packet &pkt) {
+        auto it = owner.find(pkt.id);
+        if (it == owner.end())
+            return;
+        auto &core = cores[it->second.first];
+        core.inflight.erase(it->second.second);
+        owner.erase(it);
+        if (core.stalled) {
+            core.stalled = false;
+            if (pkt.arrive > core.stall_since)
+                core.stall_time[core.reason] += pkt.arrive - core.stall_since;
+            core.cur = std::max(core.cur, pkt.arrive);
+        }
+    }
+
+    // Next request of the interleaving, routed by the address map if any.
+    Interleaving::Request next_request() {
+        auto req = end_points->next();
+        if (map.enabled()) {
+            req.addr = map.address(req.addr);
+            req.id = map.target(req.addr);
+        }
+        return req;
+    }
+
+    bool has_work(Core &core) {
+        return core.has_pending || !core.backlog.empty() || !end_points->eof();
+    }
+
+    bool ready(Core &core) {
+        return !core.stalled && !core.starved && has_work(core);
+    }
+
+    // Take the next request of a core into its pending slot. Requests of
+    // other cores met on the way are kept in their backlogs, up to
+    // MAX_BACKLOG each, so that a lagging core does not drain the trace
+    // into memory. The core then waits until that backlog drains.
+    bool fetch(Core &core) {
+        if (!core.backlog.empty()) {
+            if (core.backlog.size() == MAX_BACKLOG)
+                for (auto &c : cores)
+                    c.starved = false;
+            core.pending = core.backlog.front();
+            core.backlog.pop_front();
+            return true;
+        }
+        size_t core_i = &core - cores.data();
+        while (!end_points->eof()) {
+            auto req = next_request();
+            if (req.core < 0 || req.core % cores.size() == core_i) {
+                core.pending = req;
+                return true;
+            }
+            auto &backlog = cores[req.core % cores.size()].backlog;
+            backlog.push_back(req);
+            if (backlog.size() == MAX_BACKLOG) {
+                core.starved = true;
+                return false;
+            }
+        }
+        return false;
+    }
+
+    void stall(Core &core, Core::Stall reason) {
+        core.stalled = true;
+        core.reason = reason;
+        core.stall_since = core.cur;
+        // A request may stall again after an unrelated miss completes.
+        if (core.stalled_seq != core.seq)
+            core.stall_count[reason] += 1;
+        core.stalled_seq = core.seq;
+    }
+
+    // Look up the host cache for a request at a tick, and train the
+    // prefetcher. Its prefetches are issued after the request.
+    Tick access_cache(size_t core, const Interleaving::Request &req, Tick tick,
+                      bool &hit) {
+        mrc.access(req.addr);
+        auto lookup = cache.access(core, req.addr, req.is_write, hit);
+        if (prefetcher != nullptr) {
+            auto line = req.addr / block_size;
+            prefetcher->access(line, hit);
+            prefetcher->train(line, !hit, pf_lines);
+            pf_core = core;
+            pf_tick = tick + lookup;
+        }
+        return lookup;
+    }
+
+    // Memory of a prefetched address, or false if no memory has it.
+    bool route(Interleaving::Request &req) {
+        if (map.enabled()) {
+            if (map.find(req.addr) == nullptr)
+                return false;
+            req.id = map.target(req.addr);
+            return true;
+        }
+        for (auto &ep : end_points->end_points) {
+            if (req.addr >= ep.start && req.addr - ep.start < ep.capacity) {
+                req.id = ep.id;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Prefetches only take free issue queue slots, and skip lines that are
+    // cached or being prefetched.
+    void issue_prefetches() {
+        for (auto line : pf_lines) {
+            if (q.full())
+                break;
+            if (prefetcher->pending(line) || cache.contains(line * block_size))
+                continue;
+            Interleaving::Request req{-1, line * block_size, 0, false};
+            if (!route(req))
+                continue;
+            auto pkt = issue(req, pf_tick, coherent, true);
+            prefetcher->issue(line);
+            prefetches[pkt.id] = pf_core;
+        }
+        pf_lines.clear();
+    }
+
+    // Fill the cache with the data of a prefetch. Returns false if the
+    // response is not for a prefetch.
+    bool fill_prefetch(const Packet &pkt) {
+        auto it = prefetches.find(pkt.id);
+        if (it == prefetches.end())
+            return false;
+        cache.fill(it->second, pkt.addr, false);
+        prefetcher->fill(pkt.addr / block_size);
+        prefetches.erase(it);
+        return true;
+    }
+
+    // Take the next request of the earliest ready core, or stall it.
+    bool step_core(bool coherent) {
+        if (q.full()) {
+            idle = true;
+            return false;
+        }
+        Core *core = nullptr;
+        for (auto &c : cores) {
+            if (!ready(c))
+                continue;
+            if (core == nullptr || c.cur < core->cur)
+                core = &c;
+        }
+        if (core == nullptr) {
+            if (all_issued())
+                return finish();
+            idle = true;
+            return false;
+        }
+        auto &req = core->pending;
+        if (!core->has_pending) {
+            // The rest of the trace may belong to other cores.
+            if (!fetch(*core))
+                return true;
+            core->has_pending = true;
+            core->gap = req.gap != 0 ? req.gap : inst_gap;
+        }
+        if (core->gap > 0) {
+            // Non-memory instructions overlap the outstanding misses, as
+            // far as the ROB holds them.
+            auto n = core->gap;
+            if (!core->inflight.empty()) {
+                auto end = core->inflight.begin()->first + rob_size - 1;
+                n = std::min(n, end > core->seq ? end - core->seq : 0);
+            }
+            core->frac += n / inst_rate;
+            core->cur += (Tick)core->frac;
+            core->frac -= (Tick)core->frac;
+            core->seq += n;
+            core->gap -= n;
+            if (core->gap > 0) {
+                stall(*core, Core::ROB);
+                return true;
+            }
+        }
+        if (req.tick != 0)
+            core->cur = std::max(core->cur, req.tick);
+        if (mshr_size > 0 && core->inflight.size() >= mshr_size) {
+            stall(*core, Core::MSHR);
+            return true;
+        }
+        if (!core->inflight.empty() &&
+            core->seq + 1 - core->inflight.begin()->first >= rob_size) {
+            stall(*core, Core::ROB);
+            return true;
+        }
+        if (req.dep && core->inflight.count(core->last_load)) {
+            stall(*core, Core::DEP);
+            return true;
+        }
+        core->has_pending = false;
+        core->seq += 1;
+        if (!req.is_write)
+            core->last_load = core->seq;
+        size_t core_i = core - cores.data();
+        bool hit = false;
+        Tick lookup = 0;
+        if (coherent) {
+            lookup = access_cache(core_i, req, core->cur, hit);
+        }
+        if (hit) {
+            // The window hides the hit latency.
+            stats[req.id]["Count"] += 1;
+            stats[req.id]["Bandwidth"] += burst_size * 64;
+            stats[req.id]["Average latency"] += lookup;
+            stats[-1]["Cache hit count"] += 1;
+            last_arrive = std::max(last_arrive, core->cur + lookup);
+            return true;
+        }
+        auto pkt = issue(req, core->cur + lookup, coherent);
+        core->inflight[core->seq] = pkt.id;
+        owner[pkt.id] = {core_i, core->seq};
+        cur = std::max(cur, core->cur + lookup);
+        return true;
+    }
+
+    Packet issue(const Interleaving::Request &req, Tick tick, bool coherent,
+                 bool prefetch = false) {
+        auto type = req.is_write
+                        ? (coherent ? PacketType::WT : PacketType::NT_WT)
+                        : (coherent ? PacketType::RD : PacketType::NT_RD);
+        auto pkt =
+            PktBuilder()
+                .src(self)
+                .dst(req.id)
+                .addr(req.addr)
+                .sent(tick)
+                .payload(type == PacketType::NT_WT || type == PacketType::WT
+                             ? block_size
+                             : 0)
+                .burst(burst_size)
+                .type(type)
+                .build();
+        XerxesLogger::debug() << name() << " issue packet " << pkt.id << " to "
+                              << req.id << " at " << tick << std::endl;
+        if (topology->next_node(self, req.id) == nullptr)
+            PANIC(name() + ": no route to memory " + std::to_string(req.id));
+        q.push(pkt);
+        batch.push_back(pkt);
+        if (prefetch)
+            prefetch_cnt++;
+        else
+            cur_cnt++;
+        return pkt;
+    }
+
+    // All requests issued, send the end packets once.
+    bool finish() {
         static bool ended = false;
-        if (!end_points->eof()) {
+        if (ended)
+            return false;
+        ended = true;
+        // With HDM decoders, the end points hold the decoded space only,
+        // so the memories are the targets of the decoders.
+        std::vector<TopoID> mems;
+        if (map.enabled()) {
+            for (auto &decoder : map.list())
+                for (auto id : decoder.target_list())
+                    if (std::find(mems.begin(), mems.end(), id) == mems.end())
+                        mems.push_back(id);
+        } else {
+            for (auto &ep : end_points->end_points)
+                mems.push_back(ep.id);
+        }
+        for (auto id : mems) {
+            // A packet without a route would never leave the queue.
+            if (topology->next_node(self, id) == nullptr)
+                continue;
+            auto pkt = PktBuilder()
+                           .src(self)
+                           .dst(id)
+                           .addr(0)
+                           .sent(std::max(cur, injected_at))
+                           .payload(0)
+                           .burst(0)
+                           .type(PacketType::NT_RD)
+                           .build();
+            q.push(pkt);
+            send_pkt(pkt);
+        }
+        return true;
+    }
+
+    bool step_one(bool coherent) {
+        if (rob_size > 0)
+            return step_core(coherent);
+        if (open_loop)
+            return step_open(coherent);
+        if (has_held || !end_points->eof()) {
             // If not all issued, issue a new request.
             if (q.full()) {
                 if (cur < last_arrive)
                     cur = last_arrive;
                 // Stop registering issue event if queue is full.
+                idle = true;
+                return false;
+            }
+            if (!has_held)
+                held = next_request();
+            // A dependent request is issued after the data it depends on.
+            has_held = held.dep && !q.empty();
+            if (has_held) {
+                idle = true;
                 return false;
             }
-            auto req = end_points->next();
+            auto req = held;
+            if (req.dep)
+                cur = std::max(cur, last_arrive);
             auto ep = req.id;
             auto addr = req.addr;
             cur += issue_delay;
@@ -460,68 +1308,140 @@ class Requester : public Device {
             if (req.tick != 0)
                 cur = req.tick;
             // Only check cache when coherent
-            if (coherent && cache.hit(addr)) {
+            bool hit = false;
+            Tick lookup = 0;
+            if (coherent) {
+                lookup = access_cache(0, req, cur, hit);
+            }
+            if (hit) {
                 stats[ep]["Count"] += 1;
                 stats[ep]["Bandwidth"] += burst_size * 64;
-                stats[ep]["Average latency"] += cache.delay;
+                stats[ep]["Average latency"] += lookup;
                 stats[-1]["Cache hit count"] += 1;
 
                 XerxesLogger::debug()
                     << name() << " cache hit: " << addr << "," << cur << ","
-                    << cur + cache.delay << std::endl;
-                cur += cache.delay;
+                    << cur + lookup << std::endl;
+                cur += lookup;
                 last_arrive = cur;
                 return true;
             }
             // Include cache check latency on miss only when coherent
-            if (coherent)
-                cur += cache.delay;
-            auto type = req.is_write
-                            ? (coherent ? PacketType::WT : PacketType::NT_WT)
-                            : (coherent ? PacketType::RD : PacketType::NT_RD);
-            auto pkt =
-                PktBuilder()
-                    .src(self)
-                    .dst(ep)
-                    .addr(addr)
-                    .sent(cur)
-                    .payload(type == PacketType::NT_WT || type == PacketType::WT
-                                 ? block_size
-                                 : 0)
-                    .burst(burst_size)
-                    .type(type)
-                    .build();
-            XerxesLogger::debug() << name() << " issue packet " << pkt.id
-                                  << " to " << ep << " at " << cur << std::endl;
-            q.push(pkt);
-            send_pkt(pkt);
-            cur_cnt++;
+            cur += lookup;
+            issue(req, cur, coherent);
             return true;
+        }
+        return finish();
+    }
+
+    // Measured sweep step of a tick, or -1 in a warmup.
+    int64_t load_window(Tick tick) {
+        if (load.sweep_rates.empty())
+            return tick >= load.warmup ? 0 : -1;
+        auto period = load.warmup + load.window;
+        return tick % period < load.warmup ? -1 : (int64_t)(tick / period);
+    }
+
+    // Latency counts for the step a request was injected in, bandwidth for
+    // the step its response arrives in.
+    void record_load(TopoID ep, Tick intended, Tick arrive, size_t bytes) {
+        auto s = load_window(intended);
+        if (s >= 0 && (size_t)s < curve.size()) {
+            curve[s][ep].count += 1;
+            curve[s][ep].latency += arrive - intended;
+        }
+        s = load_window(arrive);
+        if (s >= 0 && (size_t)s < curve.size())
+            curve[s][ep].bytes += bytes;
+    }
+
+    // Open-loop injection: each request is injected at its intended tick
+    // (cur), unless it waits for one of max_outstanding requests. Trace
+    // ticks, dependencies and issue_delay are ignored.
+    bool step_open(bool coherent) {
+        auto period = load.warmup + load.window;
+        if (!load.sweep_rates.empty() &&
+            cur / period >= load.sweep_rates.size())
+            stopped = true;
+        if (stopped || end_points->eof())
+            return finish();
+        if (q.full()) {
+            blocked = true;
+            idle = true;
+            return false;
+        }
+        auto req = next_request();
+        if (blocked)
+            injected_at = std::max(injected_at, last_arrive);
+        blocked = false;
+        auto tick = std::max(cur, injected_at);
+        injected_at = tick;
+        bool hit = false;
+        Tick lookup = 0;
+        if (coherent) {
+            lookup = access_cache(0, req, tick, hit);
+        }
+        if (hit) {
+            stats[req.id]["Count"] += 1;
+            stats[req.id]["Bandwidth"] += burst_size * 64;
+            stats[req.id]["Average latency"] += lookup;
+            stats[-1]["Cache hit count"] += 1;
+            record_load(req.id, cur, tick + lookup, burst_size * 64);
+            last_arrive = std::max(last_arrive, tick + lookup);
         } else {
-            if (!ended) {
-                ended = true;
-                for (auto &ep : end_points->end_points) {
-                    auto pkt = PktBuilder()
-                                   .src(self)
-                                   .dst(ep.id)
-                                   .addr(0)
-                                   .sent(cur)
-                                   .payload(0)
-                                   .burst(0)
-                                   .type(PacketType::NT_RD)
-                                   .build();
-                    q.push(pkt);
-                    send_pkt(pkt);
-                }
-                return true;
-            }
+            auto pkt = issue(req, tick + lookup, coherent);
+            injected[pkt.id] = cur;
         }
-        return false;
+        // The interval to the next request, at the rate of this step.
+        auto rate = load.sweep_rates.empty()
+                        ? load.rate
+                        : load.sweep_rates[cur / period];
+        double interval = burst_size * 64 / rate;
+        if (poisson)
+            interval = std::exponential_distribution<>(1 / interval)(load_gen);
+        load_frac += interval;
+        cur += (Tick)load_frac;
+        load_frac -= (Tick)load_frac;
+        return true;
+    }
+
+    // Issue all requests due at the tick of this event, up to the free queue
+    // slots, and hand them to the first hop at once.
+    bool step(bool coherent) {
+        auto now = next_issue();
+        bool more = step_one(coherent);
+        issue_prefetches();
+        while (more && next_issue() <= now && !all_issued()) {
+            more = step_one(coherent);
+            issue_prefetches();
+        }
+        send_pkts(batch);
+        batch.clear();
+        return more;
+    }
+
+    // Tick of the next issue event.
+    Tick next_issue() {
+        // After a blocked period, open-loop injection catches up with the
+        // intended ticks at the tick of the last injection.
+        if (open_loop)
+            return std::max(cur, injected_at);
+        if (rob_size == 0)
+            return cur;
+        Tick next = cur;
+        bool found = false;
+        for (auto &c : cores) {
+            if (!ready(c))
+                continue;
+            next = found ? std::min(next, c.cur) : c.cur;
+            found = true;
+        }
+        return next;
     }
 
     void issue_event() {
         if (step(coherent)) {
-            register_issue_event(cur);
+            register_issue_event(next_issue());
         }
     }
 
@@ -529,7 +1449,16 @@ class Requester : public Device {
         xerxes_schedule([this]() { this->issue_event(); }, tick);
     }
 
-    bool all_issued() { return end_points->eof(); }
+    bool all_issued() {
+        if (stopped)
+            return true;
+        if (has_held || !end_points->eof())
+            return false;
+        for (auto &c : cores)
+            if (c.has_pending || !c.backlog.empty())
+                return false;
+        return true;
+    }
     bool q_empty() { return q.empty(); }
 };
 } // namespace xerxes
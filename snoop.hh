@@ -2,12 +2,20 @@
 #ifndef XERXES_SNOOP_HH
 #define XERXES_SNOOP_HH
 
+#include "bus.hh"
 #include "device.hh"
+#include "mrc_profiler.hh"
 #include "utils.hh"
 
+#include <algorithm>
+#include <cmath>
 #include <map>
 #include <utility>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 namespace xerxes {
 class SnoopConfig {
   public:
@@ -16,21 +24,75 @@ class SnoopConfig {
     size_t max_burst_inv = 8;
     std::vector<std::pair<Addr, Addr>> ranges;
     std::string eviction = "LRU";
+    // Track multiple sharers per line (MESI-like), instead of one owner.
+    bool multi_sharer = false;
+    // Bytes covered by one entry. Larger than 64 makes a region filter, in
+    // which each entry keeps a presence vector of its 64B blocks.
+    size_t region_size = 64;
+    // Number of filter slices (banks). The sets are split evenly among the
+    // slices, and the slice of an address is selected by `slice_hash`,
+    // "mod" (region number modulo slices) or "xor" (XOR-folded region
+    // number, slices should be a power of 2).
+    size_t slices = 1;
+    std::string slice_hash = "mod";
+    // Lookup latency of each slice, one value per slice. A slice serves one
+    // lookup at a time. Empty means no lookup latency.
+    std::vector<Tick> slice_delay;
+    // Release the waiters of a dirty victim only after its write-back has
+    // completed in memory, instead of once the dirty data arrives.
+    bool wait_write_back = false;
+    // Background eviction. Once the valid ways of a set reach
+    // `set_watermark` of the associativity, or the valid lines of the whole
+    // filter reach `global_watermark` of its size, one line of the set is
+    // invalidated in the next idle window of the upstream link. 0 disables.
+    double set_watermark = 0;
+    double global_watermark = 0;
+    // Sample rate of the miss ratio curve profiler, 0 disables.
+    double mrc_sample_rate = 0;
 };
 } // namespace xerxes
 
 TOML11_DEFINE_CONVERSION_NON_INTRUSIVE(xerxes::SnoopConfig, line_num, assoc,
-                                       max_burst_inv, ranges, eviction);
+                                       max_burst_inv, ranges, eviction,
+                                       multi_sharer, region_size, slices,
+                                       slice_hash, slice_delay,
+                                       wait_write_back, set_watermark,
+                                       global_watermark, mrc_sample_rate);
 
 namespace xerxes {
 // 1-to-1 device, used ahead a memory endpoint to perform snooping.
 class Snoop : public Device {
-    // Abstract class for eviction policy.
+    // Abstract class for eviction policy. Policy state is kept in flat
+    // per-way arrays (index `set_i * assoc + way_i`) and per-set masks, so
+    // each update is O(1) and the memory is O(lines).
     class SnoopEviction {
       protected:
         size_t size;
         size_t assoc;
         size_t setn;
+        // Ways that can be chosen as victim, bit `w` stands for way `w`.
+        std::vector<uint64_t> tracked;
+
+        size_t index(size_t set_i, size_t way_i) {
+            return set_i * assoc + way_i;
+        }
+        bool is_tracked(size_t set_i, size_t way_i) {
+            return (tracked[set_i] >> way_i) & 1;
+        }
+        void track(size_t set_i, size_t way_i) {
+            tracked[set_i] |= (uint64_t)1 << way_i;
+        }
+        // Stop tracking a way, i.e., it leaves the policy.
+        void untrack(size_t set_i, size_t way_i) {
+            if (!is_tracked(set_i, way_i))
+                return;
+            tracked[set_i] &= ~((uint64_t)1 << way_i);
+            on_retire(set_i, way_i);
+        }
+        // Called once when a tracked way leaves the policy.
+        virtual void on_retire(size_t set_i, size_t way_i) {}
+        // Choose a victim among the tracked ways of a (non-empty) set.
+        virtual size_t select(size_t set_i) = 0;
 
       public:
         SnoopEviction() {}
@@ -39,79 +101,84 @@ class Snoop : public Device {
             this->size = size;
             this->assoc = assoc;
             this->setn = size / assoc;
+            tracked.resize(setn, 0);
         }
         // Defaultly we do nothing.
         virtual void on_hit(Addr addr, size_t set_i, size_t way_i) {}
         virtual void on_update(Addr addr, size_t set_i, size_t way_i) {}
         virtual void on_insert(Addr addr, size_t set_i, size_t way_i) {}
-        virtual void on_invalidate(Addr addr, size_t set_i, size_t way_i) {}
+        virtual void on_invalidate(Addr addr, size_t set_i, size_t way_i) {
+            untrack(set_i, way_i);
+        }
         virtual void on_evict(Addr addr, size_t set_i, size_t way_i) {}
-        virtual ssize_t find_victim(size_t set_i, bool do_evict) = 0;
+        // Choose a victim among the tracked ways in `allowed`, -1 if none.
+        ssize_t find_victim(size_t set_i, bool do_evict,
+                            uint64_t allowed = ~(uint64_t)0) {
+            auto all = tracked[set_i];
+            if ((all & allowed) == 0)
+                return -1;
+            tracked[set_i] = all & allowed;
+            auto victim = select(set_i);
+            tracked[set_i] = all;
+            if (do_evict)
+                untrack(set_i, victim);
+            return victim;
+        }
     };
 
     class FIFO : public SnoopEviction {
       protected:
-        std::vector<std::list<size_t>> queues;
-
-      public:
-        FIFO() : SnoopEviction() {}
+        // Stamp of the last insertion (or access, for LRU/MRU) of each way.
+        std::vector<uint64_t> stamps;
+        uint64_t clock = 0;
 
-        void init(size_t size, size_t assoc) override {
-            SnoopEviction::init(size, assoc);
-            queues.resize(setn, std::list<size_t>{});
+        void touch(size_t set_i, size_t way_i) {
+            track(set_i, way_i);
+            stamps[index(set_i, way_i)] = ++clock;
         }
 
-        void on_invalidate(Addr addr, size_t set_i, size_t way_i) override {
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (*it == way_i) {
-                    q.erase(it);
-                    return;
+        // The tracked way with the smallest (oldest) or largest stamp.
+        size_t by_stamp(size_t set_i, bool newest) {
+            size_t victim = 0;
+            bool found = false;
+            for (auto m = tracked[set_i]; m != 0; m &= m - 1) {
+                size_t way_i = __builtin_ctzll(m);
+                auto s = stamps[index(set_i, way_i)];
+                if (!found || (newest ? s > stamps[index(set_i, victim)]
+                                      : s < stamps[index(set_i, victim)])) {
+                    victim = way_i;
+                    found = true;
                 }
             }
+            return victim;
         }
 
-        void on_insert(Addr addr, size_t set_i, size_t way_i) override {
-            bool exist = false;
-            for (auto &way : queues[set_i]) {
-                if (way == way_i) {
-                    exist = true;
-                    break;
-                }
-            }
-            if (!exist) {
-                if (queues[set_i].size() == assoc) {
-                    queues[set_i].pop_back();
-                }
-                queues[set_i].push_front(way_i);
-            }
+        size_t select(size_t set_i) override { return by_stamp(set_i, false); }
+
+      public:
+        FIFO() : SnoopEviction() {}
+
+        void init(size_t size, size_t assoc) override {
+            SnoopEviction::init(size, assoc);
+            stamps.resize(size, 0);
         }
 
-        ssize_t find_victim(size_t set_i, bool do_evict) override {
-            if (queues[set_i].empty())
-                return -1;
-            auto victim = queues[set_i].back();
-            if (do_evict)
-                queues[set_i].pop_back();
-            return victim;
+        void on_insert(Addr addr, size_t set_i, size_t way_i) override {
+            if (!is_tracked(set_i, way_i))
+                touch(set_i, way_i);
         }
     };
 
     class LIFO : public FIFO {
-      public:
-        LIFO() : FIFO() {}
+      protected:
         /*
           on_insert() and on_update() are the same as FIFO.
-          The front of the queue is the last inserted way.
+          The largest stamp is the last inserted way.
         */
-        ssize_t find_victim(size_t set_i, bool do_evict) override {
-            if (queues[set_i].empty())
-                return -1;
-            auto victim = queues[set_i].front();
-            if (do_evict)
-                queues[set_i].pop_front();
-            return victim;
-        }
+        size_t select(size_t set_i) override { return by_stamp(set_i, true); }
+
+      public:
+        LIFO() : FIFO() {}
     };
 
     class LRU : public FIFO {
@@ -119,149 +186,291 @@ class Snoop : public Device {
         LRU() : FIFO() {}
 
         /*
-          When update queue on hit, the front of the queue is the most recently
-          used way, and the back of the queue is the least recently used way.
+          Stamps are refreshed on hit, so the largest stamp is the most
+          recently used way, and the smallest is the least recently used.
         */
 
         void on_hit(Addr addr, size_t set_i, size_t way_i) override {
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (*it == way_i) {
-                    q.erase(it);
-                    q.push_front(way_i);
-                    return;
-                }
-            }
+            if (is_tracked(set_i, way_i))
+                touch(set_i, way_i);
         }
 
         void on_insert(Addr addr, size_t set_i, size_t way_i) override {
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (*it == way_i) {
-                    q.erase(it);
-                    break;
-                }
-            }
-            if (queues[set_i].size() == assoc) {
-                queues[set_i].pop_back();
-            }
-            queues[set_i].push_front(way_i);
+            touch(set_i, way_i);
         }
 
         void on_update(Addr addr, size_t set_i, size_t way_i) override {
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (*it == way_i) {
-                    q.erase(it);
-                    break;
-                }
-            }
-            q.push_front(way_i);
+            touch(set_i, way_i);
         }
     };
 
     class MRU : public LRU {
+      protected:
+        size_t select(size_t set_i) override { return by_stamp(set_i, true); }
+
       public:
         MRU() : LRU() {}
-
-        ssize_t find_victim(size_t set_i, bool do_evict) override {
-            if (queues[set_i].empty())
-                return -1;
-            auto victim = queues[set_i].front();
-            if (do_evict)
-                queues[set_i].pop_front();
-            return victim;
-        }
     };
 
-    // LFI (Least Frequently Inserted address) eviction policy.
-    class LFI : public SnoopEviction {
+    // LFI (Least Frequently Inserted address) eviction policy. Insertion
+    // counts are kept in a hashed table of O(lines) counters rather than
+    // per address, ties go to the most recently inserted way.
+    class LFI : public FIFO {
       protected:
-        struct Entry {
-            Addr addr;
-            size_t way_i;
-        };
-        std::vector<std::list<Entry>> queues;
-        std::unordered_map<Addr, size_t> insert_cnt;
+        std::vector<uint32_t> insert_cnt;
+        std::vector<size_t> slot;
 
-      public:
-        LFI() : SnoopEviction() {}
+        size_t slot_of(Addr addr) {
+            // Fibonacci hashing of the block address.
+            return ((addr / 64) * 0x9E3779B97F4A7C15ull) >>
+                   (64 - __builtin_ctzll(insert_cnt.size()));
+        }
 
-        void init(size_t size, size_t assoc) override {
-            SnoopEviction::init(size, assoc);
-            queues.resize(setn, std::list<Entry>{});
+        void count(Addr addr, size_t set_i, size_t way_i) {
+            auto s = slot_of(addr);
+            insert_cnt[s] += 1;
+            slot[index(set_i, way_i)] = s;
         }
 
-        void on_invalidate(Addr addr, size_t set_i, size_t way_i) override {
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (it->way_i == way_i) {
-                    q.erase(it);
-                    return;
+        size_t select(size_t set_i) override {
+            size_t victim = 0;
+            bool found = false;
+            for (auto m = tracked[set_i]; m != 0; m &= m - 1) {
+                size_t way_i = __builtin_ctzll(m);
+                auto k = insert_cnt[slot[index(set_i, way_i)]];
+                auto v = insert_cnt[slot[index(set_i, victim)]];
+                if (!found || k < v ||
+                    (k == v && stamps[index(set_i, way_i)] >
+                                   stamps[index(set_i, victim)])) {
+                    victim = way_i;
+                    found = true;
                 }
             }
+            return victim;
+        }
+
+      public:
+        LFI() : FIFO() {}
+
+        void init(size_t size, size_t assoc) override {
+            FIFO::init(size, assoc);
+            size_t n = 1;
+            while (n < size * 4)
+                n <<= 1;
+            insert_cnt.resize(n, 0);
+            slot.resize(size, 0);
         }
 
         void on_insert(Addr addr, size_t set_i, size_t way_i) override {
-            if (insert_cnt.find(addr) == insert_cnt.end()) {
-                insert_cnt[addr] = 0;
-            }
-            insert_cnt[addr] += 1;
-            bool exist = false;
-            for (auto &e : queues[set_i]) {
-                if (e.way_i == way_i) {
-                    exist = true;
-                    break;
+            count(addr, set_i, way_i);
+            if (!is_tracked(set_i, way_i))
+                touch(set_i, way_i);
+        }
+
+        void on_update(Addr addr, size_t set_i, size_t way_i) override {
+            count(addr, set_i, way_i);
+            touch(set_i, way_i);
+        }
+    };
+
+    // Tree pseudo-LRU, `assoc - 1` bits per set. Each node points to the
+    // half that should be evicted next.
+    class PLRU : public SnoopEviction {
+      protected:
+        std::vector<uint64_t> bits;
+
+        uint64_t range_mask(size_t lo, size_t hi) {
+            auto n = hi - lo;
+            return (n == 64 ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1)) << lo;
+        }
+
+        void touch(size_t set_i, size_t way_i) {
+            track(set_i, way_i);
+            auto &b = bits[set_i];
+            size_t node = 1, lo = 0, hi = assoc;
+            while (hi - lo > 1) {
+                auto mid = (lo + hi) / 2;
+                if (way_i < mid) {
+                    b |= (uint64_t)1 << node; // Point to right.
+                    node = node * 2;
+                    hi = mid;
+                } else {
+                    b &= ~((uint64_t)1 << node); // Point to left.
+                    node = node * 2 + 1;
+                    lo = mid;
                 }
             }
-            if (!exist) {
-                if (queues[set_i].size() == assoc) {
-                    queues[set_i].pop_back();
+        }
+
+        size_t select(size_t set_i) override {
+            auto b = bits[set_i];
+            auto t = tracked[set_i];
+            size_t node = 1, lo = 0, hi = assoc;
+            while (hi - lo > 1) {
+                auto mid = (lo + hi) / 2;
+                bool right = (b >> node) & 1;
+                // Skip the half without any victim candidate.
+                if (right && (t & range_mask(mid, hi)) == 0)
+                    right = false;
+                else if (!right && (t & range_mask(lo, mid)) == 0)
+                    right = true;
+                if (right) {
+                    node = node * 2 + 1;
+                    lo = mid;
+                } else {
+                    node = node * 2;
+                    hi = mid;
                 }
-                queues[set_i].push_front({addr, way_i});
             }
+            return lo;
+        }
+
+      public:
+        PLRU() : SnoopEviction() {}
+
+        void init(size_t size, size_t assoc) override {
+            ASSERT((assoc & (assoc - 1)) == 0,
+                   "snoop: PLRU needs power-of-two assoc");
+            SnoopEviction::init(size, assoc);
+            bits.resize(setn, 0);
+        }
+
+        void on_hit(Addr addr, size_t set_i, size_t way_i) override {
+            if (is_tracked(set_i, way_i))
+                touch(set_i, way_i);
+        }
+
+        void on_insert(Addr addr, size_t set_i, size_t way_i) override {
+            touch(set_i, way_i);
         }
 
         void on_update(Addr addr, size_t set_i, size_t way_i) override {
-            if (insert_cnt.find(addr) == insert_cnt.end()) {
-                insert_cnt[addr] = 0;
-            }
-            insert_cnt[addr] += 1;
-            auto &q = queues[set_i];
-            for (auto it = q.begin(); it != q.end(); ++it) {
-                if (it->way_i == way_i) {
-                    q.erase(it);
-                    break;
-                }
-            }
-            q.push_front({addr, way_i});
+            touch(set_i, way_i);
         }
+    };
 
-        ssize_t find_victim(size_t set_i, bool do_evict) override {
-            if (queues[set_i].empty())
-                return -1;
-            size_t ecnt = INT_MAX;
-            size_t victim = -1;
-            for (auto &e : queues[set_i]) {
-                size_t k = 0;
-                if (insert_cnt.find(e.addr) != insert_cnt.end())
-                    k = insert_cnt[e.addr];
-                if (k < ecnt) {
-                    ecnt = k;
-                    victim = e.way_i;
+    // Static re-reference interval prediction with 2-bit RRPVs.
+    class SRRIP : public SnoopEviction {
+      protected:
+        static constexpr uint8_t max_rrpv = 3;
+        std::vector<uint8_t> rrpv;
+
+        // RRPV of a newly inserted way.
+        virtual uint8_t insert_rrpv(Addr addr, size_t set_i, size_t way_i) {
+            return max_rrpv - 1;
+        }
+
+        size_t select(size_t set_i) override {
+            // Take the first way with the largest RRPV, and age the set so
+            // that its RRPV reaches max_rrpv.
+            size_t victim = 0;
+            uint8_t oldest = 0;
+            bool found = false;
+            for (auto m = tracked[set_i]; m != 0; m &= m - 1) {
+                size_t way_i = __builtin_ctzll(m);
+                if (!found || rrpv[index(set_i, way_i)] > oldest) {
+                    victim = way_i;
+                    oldest = rrpv[index(set_i, way_i)];
+                    found = true;
                 }
             }
-            if (do_evict) {
-                auto &q = queues[set_i];
-                for (auto it = q.begin(); it != q.end(); ++it) {
-                    if (it->way_i == victim) {
-                        q.erase(it);
-                        break;
-                    }
-                }
+            if (oldest < max_rrpv) {
+                for (auto m = tracked[set_i]; m != 0; m &= m - 1)
+                    rrpv[index(set_i, __builtin_ctzll(m))] += max_rrpv - oldest;
             }
             return victim;
         }
+
+      public:
+        SRRIP() : SnoopEviction() {}
+
+        void init(size_t size, size_t assoc) override {
+            SnoopEviction::init(size, assoc);
+            rrpv.resize(size, max_rrpv);
+        }
+
+        void on_hit(Addr addr, size_t set_i, size_t way_i) override {
+            if (is_tracked(set_i, way_i))
+                rrpv[index(set_i, way_i)] = 0;
+        }
+
+        void on_insert(Addr addr, size_t set_i, size_t way_i) override {
+            track(set_i, way_i);
+            rrpv[index(set_i, way_i)] = insert_rrpv(addr, set_i, way_i);
+        }
+
+        void on_update(Addr addr, size_t set_i, size_t way_i) override {
+            if (is_tracked(set_i, way_i))
+                on_hit(addr, set_i, way_i);
+            else
+                on_insert(addr, set_i, way_i);
+        }
+    };
+
+    // Bimodal RRIP: inserts at distant RRPV, and at long RRPV once every
+    // `throttle` insertions.
+    class BRRIP : public SRRIP {
+      protected:
+        static constexpr size_t throttle = 32;
+        size_t insert_cnt = 0;
+
+        uint8_t insert_rrpv(Addr addr, size_t set_i, size_t way_i) override {
+            if (++insert_cnt % throttle == 0)
+                return max_rrpv - 1;
+            return max_rrpv;
+        }
+
+      public:
+        BRRIP() : SRRIP() {}
+    };
+
+    // SHiP-style RRIP. Without PCs in packets, the signature is the 4 KiB
+    // page of the address. A table of saturating counters learns whether
+    // lines of a signature get re-referenced while in the filter.
+    class SHiP : public SRRIP {
+      protected:
+        static constexpr size_t shct_size = 16384;
+        static constexpr uint8_t shct_max = 7;
+        std::vector<uint8_t> shct;
+        std::vector<uint16_t> sig;
+        std::vector<bool> reused;
+
+        uint16_t signature(Addr addr) {
+            return ((addr >> 12) * 0x9E3779B97F4A7C15ull) >> 50;
+        }
+
+        uint8_t insert_rrpv(Addr addr, size_t set_i, size_t way_i) override {
+            auto i = index(set_i, way_i);
+            sig[i] = signature(addr);
+            reused[i] = false;
+            return shct[sig[i]] == 0 ? max_rrpv : max_rrpv - 1;
+        }
+
+        void on_retire(size_t set_i, size_t way_i) override {
+            auto i = index(set_i, way_i);
+            if (!reused[i] && shct[sig[i]] > 0)
+                shct[sig[i]] -= 1;
+        }
+
+      public:
+        SHiP() : SRRIP() {}
+
+        void init(size_t size, size_t assoc) override {
+            SRRIP::init(size, assoc);
+            shct.resize(shct_size, 1);
+            sig.resize(size, 0);
+            reused.resize(size, false);
+        }
+
+        void on_hit(Addr addr, size_t set_i, size_t way_i) override {
+            if (!is_tracked(set_i, way_i))
+                return;
+            auto i = index(set_i, way_i);
+            if (!reused[i] && shct[sig[i]] < shct_max)
+                shct[sig[i]] += 1;
+            reused[i] = true;
+            rrpv[i] = 0;
+        }
     };
 
     // Set-associative snoop cache.
@@ -270,68 +479,225 @@ class Snoop : public Device {
     size_t set_num;
 
     size_t max_burst_inv;
+    size_t region_size;
+
+    // Filter slices.
+    struct Slice {
+        Tick delay = 0;
+        Timeline timeline;
+        // Statistics.
+        double access_count = 0;
+        double conflict_count = 0;
+        double queuing_time = 0;
+        size_t max_waiting = 0;
+    };
+    size_t slice_num;
+    size_t slice_sets;
+    bool xor_slice;
+    std::vector<Slice> slices;
 
     SnoopEviction *eviction;
     bool log_inv = false;
+    bool multi_sharer;
+    bool wait_write_back;
+    // Background eviction thresholds, 0 disables.
+    size_t set_threshold;
+    size_t global_threshold;
+    size_t valid_lines = 0;
+    // The line of each set with a background eviction in flight, or
+    // NO_BG_VICTIM.
+    static constexpr Addr NO_BG_VICTIM = (Addr)-1;
+    std::vector<Addr> bg_victims;
 
     enum State {
         EXCLUSIVE,
         WAIT_DRAM,
         EVICTING,
         INVALID,
+        SHARED,   // Read by several hosts (multi_sharer only).
+        MODIFIED, // Written by its only sharer (multi_sharer only).
     };
 
-    struct Line {
-        Addr addr;
-        TopoID owner;
-        State state;
-        bool valid;
-    };
-
-    std::vector<std::vector<Line>> cache;
+    // Tag store in structure-of-arrays layout. Way `w` of set `s` lives at
+    // index `s * assoc + w`, so the tags of a set are contiguous and can be
+    // compared in one pass.
+    std::vector<Addr> tags;
+    std::vector<TopoID> owners;
+    // Hosts holding each line, bit `b` stands for host `hosts[b]`.
+    std::vector<uint64_t> sharers;
+    std::vector<State> states;
+    // Present 64B blocks of each entry (region filter only).
+    std::vector<uint64_t> blocks;
+    // Written 64B blocks of each entry, to be written back on invalidation.
+    std::vector<uint64_t> dirty;
+    // Valid bits of each set, bit `w` stands for way `w`.
+    std::vector<uint64_t> valid;
+    uint64_t full_mask;
+    // Region-presence index. For each owner, a bitmap of the lines it holds
+    // in every aligned region of `max_burst_inv` lines (keyed by region).
+    std::unordered_map<TopoID, std::unordered_map<Addr, uint64_t>> presence;
     std::vector<std::map<PktID, Packet>> waiting;
     std::vector<std::pair<Addr, Addr>> ranges;
+    std::unordered_map<TopoID, size_t> host_bits;
+    std::vector<TopoID> hosts;
+    // Memory behind this snoop, learned from the coherent requests.
+    TopoID home = -1;
+    // Outstanding write-backs of each held entry (wait_write_back only).
+    std::unordered_map<size_t, size_t> wb_pending;
+    // Lines of the INV response being handled.
+    struct InvLine {
+        size_t set_i;
+        ssize_t way_i;
+        size_t wbs;
+    };
+    std::vector<InvLine> inv_lines;
 
     // Statistics.
     std::unordered_map<TopoID, double> host_trig_conflict_count;
     std::unordered_map<size_t, double> burst_inv_size_count;
     std::unordered_map<Addr, size_t> evict_count;
+    double inv_pkt_count = 0;
+    double inv_line_count = 0;
+    double multicast_inv_count = 0;
+    double shared_read_count = 0;
+    double inv_wait_time = 0;
+    double wb_pkt_count = 0;
+    std::vector<double> set_access_count;
+    MRCProfiler mrc;
+    double demand_evict_count = 0;
+    double bg_evict_count = 0;
+    double bg_inv_pkt_count = 0;
+    double bg_idle_wait = 0;
 
-    size_t set_of(Addr addr) { return (addr / 64) % set_num; }
+    size_t slice_of(Addr region) {
+        if (!xor_slice)
+            return region % slice_num;
+        size_t bits = __builtin_ctzll(slice_num);
+        Addr h = 0;
+        for (; region != 0; region >>= bits)
+            h ^= region;
+        return h & (slice_num - 1);
+    }
+    // Sets are grouped by slice, slice `k` owns the sets
+    // [k * slice_sets, (k + 1) * slice_sets).
+    size_t set_of(Addr addr) {
+        auto region = addr / region_size;
+        if (slice_num == 1)
+            return region % set_num;
+        return slice_of(region) * slice_sets + region / slice_num % slice_sets;
+    }
+    // Tag of the entry covering addr. Line filters keep the raw address.
+    Addr key_of(Addr addr) {
+        return region_size > 64 ? addr / region_size * region_size : addr;
+    }
+    uint64_t block_bit(Addr addr) {
+        return (uint64_t)1 << (addr % region_size / 64);
+    }
+    size_t index(size_t set_i, size_t way_i) { return set_i * assoc + way_i; }
 
-    ssize_t hit(Addr addr, TopoID owner) {
-        auto set_i = set_of(addr);
-        auto &set = cache[set_i];
-        for (ssize_t i = 0; i < (ssize_t)assoc; ++i) {
-            auto &line = set[i];
-            if (line.valid && line.addr == addr) {
-                if (eviction)
-                    eviction->on_hit(addr, set_i, i);
-                return i;
-            }
+    uint64_t host_bit(TopoID host) {
+        auto it = host_bits.find(host);
+        if (it != host_bits.end())
+            return (uint64_t)1 << it->second;
+        ASSERT(hosts.size() < 64, name() + ": more than 64 hosts");
+        host_bits[host] = hosts.size();
+        hosts.push_back(host);
+        return (uint64_t)1 << (hosts.size() - 1);
+    }
+
+    void add_sharer(size_t i, TopoID host) {
+        sharers[i] |= host_bit(host);
+        set_present(tags[i], host, true);
+    }
+
+    void remove_sharer(size_t i, TopoID host) {
+        sharers[i] &= ~host_bit(host);
+        set_present(tags[i], host, false);
+    }
+
+    // Compare `addr` with `n` contiguous tags. Bit i of the result is set if
+    // tags[i] == addr.
+    static uint64_t match_tags(const Addr *tags, size_t n, Addr addr) {
+        uint64_t mask = 0;
+        size_t i = 0;
+#if defined(__AVX2__)
+        auto key = _mm256_set1_epi64x((long long)addr);
+        for (; i + 4 <= n; i += 4) {
+            auto t = _mm256_loadu_si256((const __m256i *)(tags + i));
+            auto eq = _mm256_cmpeq_epi64(t, key);
+            mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
         }
-        return -1;
+#elif defined(__SSE2__)
+        // No 64-bit compare in SSE2, combine the two 32-bit halves instead.
+        auto key = _mm_set1_epi64x((long long)addr);
+        for (; i + 2 <= n; i += 2) {
+            auto t = _mm_loadu_si128((const __m128i *)(tags + i));
+            auto eq = _mm_cmpeq_epi32(t, key);
+            eq = _mm_and_si128(eq,
+                               _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+            mask |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+        }
+#endif
+        for (; i < n; ++i)
+            mask |= (uint64_t)(tags[i] == addr) << i;
+        return mask;
+    }
+
+    // Find the way holding addr, without touching the eviction policy.
+    ssize_t lookup(Addr addr) {
+        auto set_i = set_of(addr);
+        auto mask = match_tags(&tags[index(set_i, 0)], assoc, key_of(addr));
+        mask &= valid[set_i];
+        if (mask == 0)
+            return -1;
+        return __builtin_ctzll(mask);
+    }
+
+    ssize_t hit(Addr addr, TopoID owner) {
+        auto way_i = lookup(addr);
+        if (way_i != -1 && eviction)
+            eviction->on_hit(addr, set_of(addr), way_i);
+        return way_i;
     }
 
     ssize_t new_way(Addr addr) {
-        auto &set = cache[set_of(addr)];
-        for (ssize_t i = 0; i < (ssize_t)assoc; ++i) {
-            auto &line = set[i];
-            if (!line.valid)
-                return i;
-        }
-        return -1;
+        auto free = ~valid[set_of(addr)] & full_mask;
+        if (free == 0)
+            return -1;
+        return __builtin_ctzll(free);
     }
 
     void update(Addr addr, size_t set_i, size_t way_i, TopoID owner,
                 State state, bool valid, bool update_evict = true) {
-        bool is_insert = !cache[set_i][way_i].valid && valid;
-        bool is_invalidate = cache[set_i][way_i].valid && !valid;
-        auto &line = cache[set_i][way_i];
-        line.addr = addr;
-        line.owner = owner;
-        line.state = state;
-        line.valid = valid;
+        auto i = index(set_i, way_i);
+        auto bit = (uint64_t)1 << way_i;
+        bool was_valid = (this->valid[set_i] & bit) != 0;
+        bool is_insert = !was_valid && valid;
+        bool is_invalidate = was_valid && !valid;
+        // Keep the presence vector if the entry still covers the same region.
+        bool same = was_valid && valid && tags[i] == key_of(addr);
+        blocks[i] = valid ? (same ? blocks[i] : 0) | block_bit(addr) : 0;
+        if (!same)
+            dirty[i] = 0;
+        addr = key_of(addr);
+        if (was_valid) {
+            for (auto m = sharers[i]; m != 0; m &= m - 1)
+                set_present(tags[i], hosts[__builtin_ctzll(m)], false);
+        }
+        tags[i] = addr;
+        owners[i] = owner;
+        states[i] = state;
+        sharers[i] = 0;
+        if (valid)
+            add_sharer(i, owner);
+        if (valid)
+            this->valid[set_i] |= bit;
+        else
+            this->valid[set_i] &= ~bit;
+        if (is_insert)
+            valid_lines += 1;
+        else if (is_invalidate)
+            valid_lines -= 1;
         if (update_evict && eviction) {
             if (is_insert)
                 eviction->on_insert(addr, set_i, way_i);
@@ -342,51 +708,80 @@ class Snoop : public Device {
         }
     }
 
-    // Check how long a burst eviction starting at addr can be performed.
+    void set_present(Addr addr, TopoID owner, bool present) {
+        if (max_burst_inv <= 1 || region_size > 64)
+            return;
+        auto region = addr / 64 / max_burst_inv;
+        auto bit = (uint64_t)1 << (addr / 64 % max_burst_inv);
+        auto &regions = presence[owner];
+        if (present) {
+            regions[region] |= bit;
+        } else {
+            auto it = regions.find(region);
+            if (it == regions.end())
+                return;
+            it->second &= ~bit;
+            if (it->second == 0)
+                regions.erase(it);
+        }
+    }
+
+    // Find the run of lines held by owner around addr, within the aligned
+    // region of addr. Only reads the presence index, so replacement state
+    // is not touched. Returns the start address and the burst length.
     // TODO: hard-coded block size 64
     std::pair<Addr, size_t> peek_burst_evict(Addr addr, TopoID owner) {
-        size_t burst = 1;
-        auto begin_addr = addr;
-        auto end_addr = addr;
-        bool flag = true;
-        while (flag && begin_addr <= addr &&
-               addr - begin_addr < max_burst_inv * 64) {
-            auto way = hit(begin_addr - 64, owner);
-            if (way != -1) {
-                begin_addr -= 64;
-                burst += 1;
-            } else {
-                flag = false;
-            }
+        if (region_size > 64) {
+            // Region filter: cover the present blocks of the entry.
+            auto way_i = lookup(addr);
+            uint64_t present = 1;
+            if (way_i != -1)
+                present = blocks[index(set_of(addr), way_i)];
+            size_t lo = __builtin_ctzll(present);
+            size_t hi = 64 - __builtin_clzll(present);
+            return {key_of(addr) + lo * 64, hi - lo};
         }
-        flag = true;
-        while (flag && end_addr >= addr &&
-               end_addr - addr < max_burst_inv * 64) {
-            auto way = hit(end_addr + 64, owner);
-            if (way != -1) {
-                end_addr += 64;
-                burst += 1;
-            } else {
-                flag = false;
-            }
+        if (max_burst_inv <= 1)
+            return {addr, 1};
+        auto region = addr / 64 / max_burst_inv;
+        size_t b = addr / 64 % max_burst_inv;
+        uint64_t mask = (uint64_t)1 << b;
+        auto regions = presence.find(owner);
+        if (regions != presence.end()) {
+            auto it = regions->second.find(region);
+            if (it != regions->second.end())
+                mask |= it->second;
         }
-        return {begin_addr, burst};
+        // Ones from bit b upward, and the first zero below bit b.
+        auto above = ~(mask >> b);
+        size_t hi = above == 0 ? 64 : b + __builtin_ctzll(above);
+        auto below = ~mask & (((uint64_t)1 << b) - 1);
+        size_t lo = below == 0 ? 0 : 64 - __builtin_clzll(below);
+        return {(region * max_burst_inv + lo) * 64, hi - lo};
     }
 
     void conduct_burst_evict(Addr start, size_t burst, TopoID owner,
                              Tick tick) {
         // Evict a range of lines, [start, start + burst * 64).
         for (size_t i = 0; i < burst; ++i) {
-            auto way = hit(start + i * 64, owner);
+            // A region entry covers several lines of the burst.
+            if (i > 0 && key_of(start + i * 64) == key_of(start + i * 64 - 64))
+                continue;
+            auto way = lookup(start + i * 64);
             if (way != -1) {
-                auto &line = cache[set_of(start + i * 64)][way];
-                if (evict_count.find(line.addr) == evict_count.end()) {
-                    evict_count[line.addr] = 0;
+                auto set_i = set_of(start + i * 64);
+                auto addr = tags[index(set_i, way)];
+                if (evict_count.find(addr) == evict_count.end()) {
+                    evict_count[addr] = 0;
                 }
-                evict_count[line.addr] += 1;
-                line.state = EVICTING;
+                evict_count[addr] += 1;
+                inv_line_count +=
+                    __builtin_popcountll(blocks[index(set_i, way)]);
+                // Lines shared with other hosts only lose this sharer.
+                if (sharers[index(set_i, way)] == host_bit(owner))
+                    states[index(set_i, way)] = EVICTING;
                 if (eviction != nullptr)
-                    eviction->on_evict(line.addr, set_of(start + i * 64), way);
+                    eviction->on_evict(addr, set_i, way);
             }
         }
         auto inv = PktBuilder()
@@ -400,36 +795,133 @@ class Snoop : public Device {
                        .dst(owner)
                        .is_rsp(false)
                        .build();
-        XerxesLogger::debug()
-            << name() << ": evict packet " << inv.id << ", addr " << start
-            << ", burst " << burst << ", owner " << owner << std::endl;
+        DEBUG_LOG(name() << ": evict packet " << inv.id << ", addr " << start
+                         << ", burst " << burst << ", owner " << owner
+                         << std::endl);
+        inv_pkt_count += 1;
         send_pkt(inv);
     }
 
+    // Invalidate line i at all its sharers. Without multicast support in
+    // the fabric, the multicast is sent as one (burst) INV per sharer.
+    void invalidate_sharers(size_t i, Tick tick, bool count_burst) {
+        auto addr = tags[i];
+        auto mask = sharers[i];
+        if (__builtin_popcountll(mask) > 1)
+            multicast_inv_count += 1;
+        for (; mask != 0; mask &= mask - 1) {
+            auto host = hosts[__builtin_ctzll(mask)];
+            auto peek = peek_burst_evict(addr, host);
+            if (count_burst) {
+                if (burst_inv_size_count.find(peek.second) ==
+                    burst_inv_size_count.end()) {
+                    burst_inv_size_count[peek.second] = 0;
+                }
+                burst_inv_size_count[peek.second] += 1;
+            }
+            conduct_burst_evict(peek.first, peek.second, host, tick);
+        }
+        states[i] = EVICTING;
+    }
+
     void evict(size_t set_i, Tick tick) {
         ASSERT(eviction != nullptr, name() + ": eviction policy is null");
-        auto &set = cache[set_i];
         auto victim = eviction->find_victim(set_i, true);
-        XerxesLogger::debug() << name() << ": evict victim [" << set_i << ": "
-                              << victim << "]" << std::endl;
+        DEBUG_LOG(name() << ": evict victim [" << set_i << ": " << victim << "]"
+                         << std::endl);
         if (victim != -1) {
-            auto &line = set[victim];
-            auto peek = peek_burst_evict(line.addr, line.owner);
-
-            if (burst_inv_size_count.find(peek.second) ==
-                burst_inv_size_count.end()) {
-                burst_inv_size_count[peek.second] = 0;
-            }
-            burst_inv_size_count[peek.second] += 1;
-
-            conduct_burst_evict(peek.first, peek.second, line.owner, tick);
+            demand_evict_count += 1;
+            invalidate_sharers(index(set_i, victim), tick, true);
         } else {
             // No victim, do nothing.
         }
     }
 
+    // First idle window, at or after tick, of the link toward host. Only a
+    // bus link is searched, other devices are assumed always idle.
+    Tick upstream_idle(TopoID host, Tick tick) {
+        auto node = topology->next_node(self, host);
+        if (node == nullptr)
+            return tick;
+        auto bus =
+            dynamic_cast<DuplexBus *>(sim->system()->find_dev(node->id()));
+        auto next = topology->next_node(node->id(), host);
+        if (bus == nullptr || next == nullptr)
+            return tick;
+        return bus->idle_window(self, next->id(), tick, 0);
+    }
+
+    // Invalidate one line of a set under pressure before any request has
+    // to wait for it. The INV is sent in an idle window of the upstream
+    // link, so it does not delay the demand traffic.
+    void pressure_evict(size_t set_i, Tick tick) {
+        if (set_threshold == 0 && global_threshold == 0)
+            return;
+        bool over =
+            (set_threshold > 0 &&
+             (size_t)__builtin_popcountll(valid[set_i]) >= set_threshold) ||
+            (global_threshold > 0 && valid_lines >= global_threshold);
+        // Demand evictions already run in sets with waiters.
+        if (!over || bg_victims[set_i] != NO_BG_VICTIM ||
+            !waiting[set_i].empty())
+            return;
+        // Lines still filling or being evicted are not settled at the
+        // host, an INV could reach it before the data does.
+        uint64_t settled = 0;
+        for (auto m = valid[set_i]; m != 0; m &= m - 1) {
+            size_t way_i = __builtin_ctzll(m);
+            auto state = states[index(set_i, way_i)];
+            if (state == EXCLUSIVE || state == SHARED || state == MODIFIED)
+                settled |= (uint64_t)1 << way_i;
+        }
+        auto victim = eviction->find_victim(set_i, true, settled);
+        if (victim == -1)
+            return;
+        auto i = index(set_i, victim);
+        auto idle = tick;
+        for (auto m = sharers[i]; m != 0; m &= m - 1) {
+            auto host = hosts[__builtin_ctzll(m)];
+            idle = std::max(idle, upstream_idle(host, tick));
+        }
+        DEBUG_LOG(name() << ": background evict [" << set_i << ": " << victim
+                         << "] at " << idle << std::endl);
+        bg_victims[set_i] = tags[i];
+        bg_evict_count += 1;
+        bg_idle_wait += idle - tick;
+        auto sent = inv_pkt_count;
+        invalidate_sharers(i, idle, true);
+        bg_inv_pkt_count += inv_pkt_count - sent;
+    }
+
+    // Look up the slice of pkt. Returns the tick the lookup finishes.
+    Tick slice_access(const Packet &pkt) {
+        auto set_i = set_of(pkt.addr);
+        auto &slice = slices[set_i / slice_sets];
+        slice.access_count += 1;
+        set_access_count[set_i] += 1;
+        if (slice.delay == 0)
+            return pkt.arrive;
+        auto start = slice.timeline.transfer_time(pkt.arrive, slice.delay);
+        slice.queuing_time += start - pkt.arrive;
+        return start + slice.delay;
+    }
+
+    // Park pkt until an eviction in its set is done.
+    void enqueue(const Packet &pkt, size_t set_i) {
+        if (host_trig_conflict_count.find(pkt.src) ==
+            host_trig_conflict_count.end()) {
+            host_trig_conflict_count[pkt.src] = 0;
+        }
+        host_trig_conflict_count[pkt.src] += 1;
+        waiting[set_i].insert(std::make_pair(pkt.id, pkt));
+        auto &slice = slices[set_i / slice_sets];
+        slice.conflict_count += 1;
+        slice.max_waiting = std::max(slice.max_waiting, waiting[set_i].size());
+    }
+
     void coherent_request(Packet pkt) {
         // Coherence packet. Need to record in snoop cache.
+        home = pkt.dst;
         auto set_i = set_of(pkt.addr);
         auto way_i = hit(pkt.addr, pkt.src);
         if (way_i == -1) {
@@ -438,55 +930,154 @@ class Snoop : public Device {
             if (new_way_i == -1) {
                 // No empty way. Need to evict. Packet need to wait until evict
                 // done.
-                if (host_trig_conflict_count.find(pkt.src) ==
-                    host_trig_conflict_count.end()) {
-                    host_trig_conflict_count[pkt.src] = 0;
-                }
-                host_trig_conflict_count[pkt.src] += 1;
-                XerxesLogger::debug()
-                    << name() << ": pkt " << pkt.id << " wait evict [" << set_i
-                    << "]" << std::endl;
-                waiting[set_i].insert(std::make_pair(pkt.id, pkt));
+                DEBUG_LOG(name() << ": pkt " << pkt.id << " wait evict ["
+                                 << set_i << "]" << std::endl);
+                enqueue(pkt, set_i);
                 evict(set_i, pkt.arrive);
             } else {
                 // Empty way. Allocate.
-                XerxesLogger::debug()
-                    << name() << ": pkt " << pkt.id << " allocate [" << set_i
-                    << ":" << new_way_i << "]" << std::endl;
+                DEBUG_LOG(name() << ": pkt " << pkt.id << " allocate [" << set_i
+                                 << ":" << new_way_i << "]" << std::endl);
                 update(pkt.addr, set_i, new_way_i, pkt.src, WAIT_DRAM, true,
                        true);
+                if (pkt.is_write())
+                    dirty[index(set_i, new_way_i)] |= block_bit(pkt.addr);
 
                 // Directly send the packet.
                 send_pkt(pkt);
+                pressure_evict(set_i, pkt.arrive);
             }
+        } else if (multi_sharer) {
+            shared_request(pkt, set_i, way_i);
         } else {
-            auto &line = cache[set_i][way_i];
-            if (line.owner != pkt.src) {
+            auto i = index(set_i, way_i);
+            if (owners[i] != pkt.src) {
                 // Conflict. Need to evict the line.
-                if (host_trig_conflict_count.find(pkt.src) ==
-                    host_trig_conflict_count.end()) {
-                    host_trig_conflict_count[pkt.src] = 0;
-                }
-                host_trig_conflict_count[pkt.src] += 1;
                 // Insert the packet to waiting list.
-                XerxesLogger::debug()
-                    << name() << ": pkt " << pkt.id << " conflict [" << set_i
-                    << ":" << way_i << "]" << std::endl;
-                waiting[set_i].insert(std::make_pair(pkt.id, pkt));
-                auto peek = peek_burst_evict(line.addr, line.owner);
-                conduct_burst_evict(peek.first, peek.second, line.owner,
-                                    pkt.arrive);
+                DEBUG_LOG(name() << ": pkt " << pkt.id << " conflict [" << set_i
+                                 << ":" << way_i << "]" << std::endl);
+                enqueue(pkt, set_i);
+                invalidate_sharers(i, pkt.arrive, false);
 
             } else {
                 // Hit. Directly send back (host should hold the data already).
-                XerxesLogger::debug()
-                    << name() << ": pkt " << pkt.id << " hit at [" << set_i
-                    << ":" << way_i << "]" << std::endl;
-                std::swap(pkt.src, pkt.dst);
-                pkt.is_rsp = true;
+                DEBUG_LOG(name() << ": pkt " << pkt.id << " hit at [" << set_i
+                                 << ":" << way_i << "]" << std::endl);
+                own_hit(pkt, i);
+            }
+        }
+    }
+
+    // The requester hits its own entry. Send back if the host should hold
+    // the block already, otherwise (region filter) fetch it from memory.
+    void own_hit(Packet pkt, size_t i) {
+        auto bit = block_bit(pkt.addr);
+        if (pkt.is_write())
+            dirty[i] |= bit;
+        if ((blocks[i] & bit) == 0) {
+            blocks[i] |= bit;
+            send_pkt(pkt);
+            return;
+        }
+        std::swap(pkt.src, pkt.dst);
+        pkt.is_rsp = true;
+        send_pkt(pkt);
+    }
+
+    // Coherent request hitting a line when multiple sharers are tracked.
+    void shared_request(Packet pkt, size_t set_i, size_t way_i) {
+        auto i = index(set_i, way_i);
+        auto bit = host_bit(pkt.src);
+        auto others = sharers[i] & ~bit;
+        if (states[i] != EVICTING && others == 0) {
+            // Only the requester holds the line, directly send back.
+            DEBUG_LOG(name() << ": pkt " << pkt.id << " hit at [" << set_i
+                             << ":" << way_i << "]" << std::endl);
+            if (pkt.is_write() && states[i] == EXCLUSIVE)
+                states[i] = MODIFIED;
+            own_hit(pkt, i);
+            return;
+        }
+        if (states[i] != EVICTING && pkt.is_read() && states[i] != MODIFIED) {
+            // Read of clean data, the requester joins the sharers.
+            shared_read_count += 1;
+            bool is_sharer = (sharers[i] & bit) != 0;
+            add_sharer(i, pkt.src);
+            if (states[i] != WAIT_DRAM)
+                states[i] = SHARED;
+            DEBUG_LOG(name() << ": pkt " << pkt.id << " share [" << set_i << ":"
+                             << way_i << "]" << std::endl);
+            if (is_sharer) {
+                own_hit(pkt, i);
+            } else {
+                blocks[i] |= block_bit(pkt.addr);
                 send_pkt(pkt);
             }
+            return;
         }
+        // Write to a shared line, or read of a modified/evicting line. Wait
+        // until all other sharers are invalidated.
+        DEBUG_LOG(name() << ": pkt " << pkt.id << " conflict [" << set_i << ":"
+                         << way_i << "]" << std::endl);
+        enqueue(pkt, set_i);
+        if (states[i] == EVICTING)
+            return; // Already invalidating.
+        // The requester gets the line again once the others are gone.
+        remove_sharer(i, pkt.src);
+        invalidate_sharers(i, pkt.arrive, false);
+    }
+
+    // Write up to `budget` of the blocks `mask` of entry i back to memory.
+    // Returns the number of write-back packets sent.
+    size_t write_back(size_t i, uint64_t mask, Tick tick, size_t &budget) {
+        size_t count = 0;
+        for (; mask != 0 && budget > 0; mask &= mask - 1, --budget) {
+            auto wb = PktBuilder()
+                          .type(PacketType::NT_WT)
+                          .addr(tags[i] + __builtin_ctzll(mask) * 64)
+                          .payload(64)
+                          .burst(1)
+                          .sent(tick)
+                          .arrive(0)
+                          .src(self)
+                          .dst(home)
+                          .is_rsp(false)
+                          .build();
+            DEBUG_LOG(name() << ": write back packet " << wb.id << ", addr "
+                             << wb.addr << std::endl);
+            send_pkt(wb);
+            count += 1;
+        }
+        wb_pkt_count += count;
+        return count;
+    }
+
+    // Let the first waiter of a set take way_i, or any free way if way_i is
+    // -1 (e.g., the line was released by an earlier response).
+    void release_waiter(size_t set_i, ssize_t way_i, Tick tick) {
+        auto waiting_it = waiting[set_i].begin();
+        if (waiting_it == waiting[set_i].end())
+            return;
+        auto &waiter = waiting_it->second;
+        if (way_i == -1)
+            way_i = new_way(waiter.addr);
+        if (way_i == -1)
+            return;
+        DEBUG_LOG(name() << ": insert waiter pkt " << waiter.id << " to ["
+                         << set_i << ":" << way_i << "]" << std::endl);
+        update(waiter.addr, set_i, way_i, waiter.src, WAIT_DRAM, true, true);
+        if (waiter.is_write())
+            dirty[index(set_i, way_i)] |= block_bit(waiter.addr);
+        // Send the waiting.
+        if (tick > waiter.arrive) {
+            waiter.delta_stat(SNOOP_EVICT_DELAY,
+                              (double)(tick - waiter.arrive));
+            inv_wait_time += tick - waiter.arrive;
+            waiter.arrive = tick;
+        }
+        send_pkt(waiter);
+        waiting[set_i].erase(waiting_it);
+        pressure_evict(set_i, tick);
     }
 
     void invalidate_response(Packet pkt) {
@@ -497,82 +1088,148 @@ class Snoop : public Device {
         auto tick = pkt.arrive;
         auto addr = pkt.addr;
         auto burst = pkt.burst;
+        // Lines to invalidate, as (set, way, write-backs), way -1 if the
+        // line is not found.
+        inv_lines.clear();
         for (size_t i = 0; i < burst; ++i) {
+            if (i > 0 && key_of(addr + i * 64) == key_of(addr + i * 64 - 64))
+                continue;
             auto set_i = set_of(addr + i * 64);
-            auto way_i = hit(addr + i * 64, pkt.src);
-            // TODO: Send the write back packet.
-            if (way_i != -1) {
-                // Invalidate the line.
-                update(0, set_i, way_i, -1, INVALID, false);
+            // The lines are leaving, so the policy is not touched.
+            auto way_i = lookup(addr + i * 64);
+            if (way_i != -1 && multi_sharer) {
+                auto li = index(set_i, way_i);
+                remove_sharer(li, pkt.src);
+                // Other sharers may still hold the line.
+                if (sharers[li] != 0)
+                    continue;
             }
-            // Check waiting.
-            auto waiting_it = waiting[set_i].begin();
-            if (waiting_it != waiting[set_i].end()) {
-                // Some packet is waiting for this eviction.
-                auto &waiter = waiting_it->second;
-                XerxesLogger::debug()
-                    << name() << ": insert waiter pkt " << waiter.id << " to ["
-                    << set_i << ":" << way_i << "]" << std::endl;
-                update(waiter.addr, set_i, way_i, waiter.src, WAIT_DRAM, true,
-                       true);
-                // Send the waiting.
-                if (tick > waiter.arrive) {
-                    waiter.delta_stat(SNOOP_EVICT_DELAY,
-                                      (double)(tick - waiter.arrive));
-                    waiter.arrive = tick;
+            // The background eviction of the set is done once its line is
+            // invalidated at the last sharer.
+            if (bg_victims[set_i] == key_of(addr + i * 64))
+                bg_victims[set_i] = NO_BG_VICTIM;
+            inv_lines.push_back({set_i, way_i, 0});
+        }
+        // The host returns the dirty data with the response. Hosts may
+        // write exclusive lines silently, so the returned data decides how
+        // many blocks are written back: the blocks known dirty of all lines
+        // first, then the others.
+        size_t budget = pkt.payload / 64;
+        for (bool known : {true, false}) {
+            for (auto &line : inv_lines) {
+                if (line.way_i == -1)
+                    continue;
+                auto li = index(line.set_i, line.way_i);
+                auto mask = known ? dirty[li] : blocks[li] & ~dirty[li];
+                line.wbs += write_back(li, mask, tick, budget);
+            }
+        }
+        for (auto &line : inv_lines) {
+            if (line.way_i != -1) {
+                auto li = index(line.set_i, line.way_i);
+                dirty[li] = 0;
+                if (line.wbs > 0 && wait_write_back) {
+                    // Hold the way until memory completes the write-backs.
+                    for (auto m = sharers[li]; m != 0; m &= m - 1)
+                        remove_sharer(li, hosts[__builtin_ctzll(m)]);
+                    owners[li] = -1;
+                    states[li] = EVICTING;
+                    wb_pending[li] = line.wbs;
+                    continue;
                 }
-                send_pkt(waiting_it->second);
-                waiting[set_i].erase(waiting_it);
+                // Invalidate the line.
+                update(0, line.set_i, line.way_i, -1, INVALID, false);
             }
+            release_waiter(line.set_i, line.way_i, tick);
         }
     }
 
-    bool in_range(Addr addr) {
+    // Write-back completed in memory.
+    void write_back_response(Packet pkt) {
+        auto set_i = set_of(pkt.addr);
+        auto way_i = lookup(pkt.addr);
+        if (way_i == -1)
+            return;
+        auto it = wb_pending.find(index(set_i, way_i));
+        if (it == wb_pending.end() || --it->second > 0)
+            return;
+        wb_pending.erase(it);
+        update(0, set_i, way_i, -1, INVALID, false);
+        release_waiter(set_i, way_i, pkt.arrive);
+    }
+
+    // Sort and merge the (inclusive) ranges, so that in_range() can binary
+    // search them.
+    void build_range_index() {
+        std::sort(ranges.begin(), ranges.end());
+        std::vector<std::pair<Addr, Addr>> merged;
         for (auto &range : ranges) {
-            if (addr >= range.first && addr <= range.second)
-                return true;
+            if (!merged.empty() && merged.back().second != (Addr)-1 &&
+                range.first <= merged.back().second + 1) {
+                merged.back().second =
+                    std::max(merged.back().second, range.second);
+            } else {
+                merged.push_back(range);
+            }
         }
-        return false;
+        ranges.swap(merged);
+    }
+
+    bool in_range(Addr addr) {
+        // The last range starting at or before addr.
+        auto it = std::upper_bound(
+            ranges.begin(), ranges.end(), addr,
+            [](Addr a, const std::pair<Addr, Addr> &r) { return a < r.first; });
+        if (it == ranges.begin())
+            return false;
+        return addr <= std::prev(it)->second;
     }
 
     void filter(Packet pkt) {
-        XerxesLogger::debug()
-            << "filter " << pkt.is_coherent() << " " << pkt.is_rsp << " "
-            << in_range(pkt.addr) << std::endl;
-        for (auto &range : ranges) {
-            XerxesLogger::debug()
-                << "range " << range.first << " " << range.second << std::endl;
-        }
+        DEBUG_LOG("filter " << pkt.is_coherent() << " " << pkt.is_rsp << " "
+                            << in_range(pkt.addr) << std::endl);
         if (pkt.is_coherent() && !pkt.is_rsp && in_range(pkt.addr)) {
             // A coherent request belongs to the address range of this snoop.
+            pkt.arrive = slice_access(pkt);
+            mrc.access(key_of(pkt.addr));
             coherent_request(pkt);
         } else if (pkt.type == PacketType::INV && pkt.is_rsp &&
                    pkt.dst == self) {
             // An INV response to this snoop.
             invalidate_response(pkt);
+        } else if (pkt.is_rsp && pkt.dst == self) {
+            // A write-back completed.
+            write_back_response(pkt);
         } else {
             // Non-temporal or response. Directly send the packet.
             if (pkt.is_rsp) {
                 auto tick = pkt.arrive;
                 auto set_i = set_of(pkt.addr);
-                auto way_i = hit(pkt.addr, pkt.dst);
+                // A fill is not a reuse, only demand hits train the policy.
+                auto way_i = lookup(pkt.addr);
                 if (way_i != -1) {
-                    XerxesLogger::debug()
-                        << name() << ": DRAM rsp pkt " << pkt.id << " hit ["
-                        << set_i << ":" << way_i << "]" << std::endl;
+                    DEBUG_LOG(name() << ": DRAM rsp pkt " << pkt.id << " hit ["
+                                     << set_i << ":" << way_i << "]"
+                                     << std::endl);
                     // Data arrived from DRAM, update the snoop cache.
-                    update(pkt.addr, set_i, way_i, pkt.dst, EXCLUSIVE, true,
-                           false);
+                    auto li = index(set_i, way_i);
+                    if (!multi_sharer) {
+                        update(pkt.addr, set_i, way_i, pkt.dst, EXCLUSIVE,
+                               true, false);
+                    } else if (states[li] == WAIT_DRAM) {
+                        if (__builtin_popcountll(sharers[li]) > 1)
+                            states[li] = SHARED;
+                        else
+                            states[li] = pkt.is_write() ? MODIFIED : EXCLUSIVE;
+                    }
                     if (waiting[set_i].size() > 0) {
                         // Try an eviction.
-                        XerxesLogger::debug()
-                            << " try evict [" << set_i << "]" << std::endl;
+                        DEBUG_LOG(" try evict [" << set_i << "]" << std::endl);
                         evict(set_i, tick);
                     }
                 }
             }
-            XerxesLogger::debug()
-                << name() << " send packet " << pkt.id << std::endl;
+            DEBUG_LOG(name() << " send packet " << pkt.id << std::endl);
             log_transit_normal(pkt);
             send_pkt(pkt);
         }
@@ -583,13 +1240,46 @@ class Snoop : public Device {
           std::string name = "Snoop")
         : Device(sim, name), line_num(config.line_num), assoc(config.assoc),
           set_num(config.line_num / config.assoc),
-          max_burst_inv(config.max_burst_inv), log_inv(false) {
+          max_burst_inv(config.max_burst_inv), region_size(config.region_size),
+          slice_num(config.slices), xor_slice(config.slice_hash == "xor"),
+          log_inv(false),
+          multi_sharer(config.multi_sharer),
+          wait_write_back(config.wait_write_back),
+          set_threshold(std::ceil(config.set_watermark * config.assoc)),
+          global_threshold(std::ceil(config.global_watermark * line_num)),
+          mrc(config.mrc_sample_rate) {
         ASSERT(line_num % assoc == 0, "snoop: size % assoc != 0");
-        cache.resize(set_num);
-        for (auto &c : cache)
-            c.resize(assoc, Line{0, false});
+        ASSERT(assoc <= 64, "snoop: assoc > 64");
+        ASSERT(max_burst_inv <= 64, "snoop: max_burst_inv > 64");
+        ASSERT(region_size >= 64 && region_size <= 4096 &&
+                   (region_size & (region_size - 1)) == 0,
+               "snoop: region_size should be a power of 2 in [64, 4096]");
+        ASSERT(slice_num > 0 && set_num % slice_num == 0,
+               "snoop: set number % slices != 0");
+        ASSERT(config.slice_hash == "mod" || config.slice_hash == "xor",
+               "snoop: unknown slice hash " + config.slice_hash);
+        ASSERT(!xor_slice || (slice_num & (slice_num - 1)) == 0,
+               "snoop: xor slice hash needs power-of-2 slices");
+        ASSERT(config.slice_delay.empty() ||
+                   config.slice_delay.size() == slice_num,
+               "snoop: slice_delay should have one value per slice");
+        slice_sets = set_num / slice_num;
+        slices.resize(slice_num);
+        for (size_t k = 0; k < config.slice_delay.size(); ++k)
+            slices[k].delay = config.slice_delay[k];
+        set_access_count.resize(set_num, 0);
+        bg_victims.resize(set_num, NO_BG_VICTIM);
+        tags.resize(line_num, 0);
+        owners.resize(line_num, -1);
+        sharers.resize(line_num, 0);
+        blocks.resize(line_num, 0);
+        dirty.resize(line_num, 0);
+        states.resize(line_num, INVALID);
+        valid.resize(set_num, 0);
+        full_mask = assoc == 64 ? ~(uint64_t)0 : ((uint64_t)1 << assoc) - 1;
         waiting.resize(set_num);
         ranges = config.ranges;
+        build_range_index();
         if (config.eviction == "FIFO") {
             eviction = new FIFO{};
         } else if (config.eviction == "LIFO") {
@@ -600,6 +1290,14 @@ class Snoop : public Device {
             eviction = new MRU{};
         } else if (config.eviction == "LFI") {
             eviction = new LFI{};
+        } else if (config.eviction == "PLRU") {
+            eviction = new PLRU{};
+        } else if (config.eviction == "SRRIP") {
+            eviction = new SRRIP{};
+        } else if (config.eviction == "BRRIP") {
+            eviction = new BRRIP{};
+        } else if (config.eviction == "SHiP") {
+            eviction = new SHiP{};
         } else {
             PANIC("Unknown eviction policy: " + config.eviction);
         }
@@ -611,8 +1309,7 @@ class Snoop : public Device {
     void transit() override {
         auto pkt = receive_pkt();
         if (!pkt.is_rsp)
-            XerxesLogger::debug()
-                << name() << " receive packet " << pkt.id << std::endl;
+            DEBUG_LOG(name() << " receive packet " << pkt.id << std::endl);
         // filter all packets
         filter(pkt);
     }
@@ -636,6 +1333,40 @@ class Snoop : public Device {
         avg_burst_inv /= total_burst_inv;
         os << " * average burst invalidation size: " << avg_burst_inv
            << std::endl;
+        os << " * INV packet count: " << inv_pkt_count << std::endl;
+        os << " * invalidated line count: " << inv_line_count << std::endl;
+        os << " * total wait for invalidation (ns): " << inv_wait_time
+           << std::endl;
+        os << " * write-back packet count: " << wb_pkt_count << std::endl;
+        mrc.log(os, line_num);
+        if (set_threshold > 0 || global_threshold > 0) {
+            os << " * demand eviction count: " << demand_evict_count
+               << std::endl;
+            os << " * background eviction count: " << bg_evict_count
+               << std::endl;
+            os << " * background INV packet count: " << bg_inv_pkt_count
+               << std::endl;
+            os << " * background wait for idle link (ns): " << bg_idle_wait
+               << std::endl;
+        }
+        if (slice_num > 1) {
+            for (size_t k = 0; k < slice_num; ++k) {
+                auto &slice = slices[k];
+                auto begin = set_access_count.begin() + k * slice_sets;
+                auto hot = std::max_element(begin, begin + slice_sets);
+                os << " * slice " << k << ": access " << slice.access_count
+                   << ", conflict " << slice.conflict_count
+                   << ", hottest set " << hot - set_access_count.begin()
+                   << " (" << *hot << " access), max waiting "
+                   << slice.max_waiting << ", queuing (ns) "
+                   << slice.queuing_time << std::endl;
+            }
+        }
+        if (multi_sharer) {
+            os << " * multicast invalidation count: " << multicast_inv_count
+               << std::endl;
+            os << " * shared read count: " << shared_read_count << std::endl;
+        }
 
         std::map<size_t, size_t> evict_count_pdf;
         for (auto &pair : evict_count) {
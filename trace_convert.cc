@@ -0,0 +1,79 @@
+#include "trace_format.hh"
+#include "trace_reader.hh"
+
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+
+// Converts a text trace to the binary trace format, or a binary trace back
+// to text. The input format is detected from its header, and the input may
+// be compressed.
+//   xerxes-trace-convert <input> <output>
+
+using namespace xerxes;
+
+static size_t file_size(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static void to_text(const std::string &in, const std::string &out) {
+    auto file = std::fopen(out.c_str(), "w");
+    ASSERT(file != nullptr, "Cannot create trace file " + out);
+    TraceReader reader(in, "binary");
+    TraceReader::Record rec;
+    while (reader.next(rec)) {
+        std::fprintf(file, "0x%" PRIx64 " %s %" PRIu64, rec.addr,
+                     rec.is_write ? "W" : "R", rec.tick);
+        if (rec.core >= 0)
+            std::fprintf(file, " %zu %d %d", rec.gap, (int)rec.dep, rec.core);
+        else if (rec.dep)
+            std::fprintf(file, " %zu 1", rec.gap);
+        else if (rec.gap != 0)
+            std::fprintf(file, " %zu", rec.gap);
+        std::fputc('\n', file);
+    }
+    std::fclose(file);
+}
+
+static void to_binary(const std::string &in, const std::string &out) {
+    // First pass: the coarsest granularity all addresses are aligned to.
+    uint32_t shift = 63;
+    {
+        TraceReader reader(in, "text");
+        TraceReader::Record rec;
+        while (reader.next(rec))
+            while (shift > 0 && (rec.addr & ((1ULL << shift) - 1)) != 0)
+                shift -= 1;
+    }
+    trace_format::Writer writer(out, shift);
+    TraceReader reader(in, "text");
+    TraceReader::Record rec;
+    while (reader.next(rec))
+        writer.write(rec.addr, rec.is_write, rec.tick, rec.gap, rec.dep,
+                     rec.core);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <input> <output>" << std::endl;
+        return 1;
+    }
+    std::string in = argv[1], out = argv[2];
+    bool binary = false;
+    {
+        TraceReader reader(in, "auto");
+        binary = reader.is_binary();
+    }
+    if (binary)
+        to_text(in, out);
+    else
+        to_binary(in, out);
+    std::cout << in << " (" << (binary ? "binary" : "text") << ", "
+              << file_size(in) << " bytes) -> " << out << " ("
+              << (binary ? "text" : "binary") << ", " << file_size(out)
+              << " bytes)" << std::endl;
+    return 0;
+}
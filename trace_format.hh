@@ -0,0 +1,139 @@
+#pragma once
+#ifndef XERXES_TRACE_FORMAT_HH
+#define XERXES_TRACE_FORMAT_HH
+
+#include "def.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace xerxes {
+// Binary trace format. A file is a fixed header followed by `count`
+// variable-length records, each being:
+//   tag byte: WRITE | DEP | HAS_GAP | HAS_TICK | HAS_CORE bits
+//   varint  : zigzag address delta from the previous record, in units of
+//             1 << addr_shift bytes
+//   [varint]: zigzag tick delta from the previous record, if HAS_TICK
+//   [varint]: instruction gap, if HAS_GAP
+//   [varint]: core id, if HAS_CORE
+// Varints are LEB128, 7 bits per byte with the low bits first.
+namespace trace_format {
+static constexpr char MAGIC[8] = {'X', 'E', 'R', 'X', 'T', 'R', 'C', '\0'};
+static constexpr uint32_t VERSION = 1;
+
+enum Tag : uint8_t {
+    WRITE = 1 << 0,
+    DEP = 1 << 1,
+    HAS_GAP = 1 << 2,
+    HAS_TICK = 1 << 3,
+    HAS_CORE = 1 << 4,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t addr_shift;
+    uint64_t count;
+    uint64_t reserved;
+};
+static_assert(sizeof(Header) == 32, "trace header should be packed");
+
+// The longest encoding of a record: a tag and four 64-bit varints.
+static constexpr size_t MAX_RECORD = 1 + 4 * 10;
+
+inline bool is_binary(const char *data, size_t size) {
+    return size >= sizeof(Header) && std::memcmp(data, MAGIC, 8) == 0;
+}
+
+inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+inline char *put_varint(char *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (char)v;
+    return p;
+}
+
+// Decode a varint, p should have at least 10 readable bytes or end in a
+// byte below 0x80.
+inline uint64_t get_varint(const char *&p) {
+    uint64_t v = 0;
+    for (int shift = 0;; shift += 7) {
+        auto b = (uint8_t)*p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (b < 0x80)
+            return v;
+    }
+}
+
+// Writes a binary trace. The address granularity (addr_shift) should be
+// known up front, e.g. from the common trailing zeros of all addresses.
+class Writer {
+    FILE *file;
+    Header header;
+    Addr last_addr = 0;
+    Tick last_tick = 0;
+
+  public:
+    Writer(const std::string &path, uint32_t addr_shift = 0) {
+        file = std::fopen(path.c_str(), "wb");
+        ASSERT(file != nullptr, "Cannot create trace file " + path);
+        std::memcpy(header.magic, MAGIC, 8);
+        header.version = VERSION;
+        header.addr_shift = addr_shift;
+        header.count = 0;
+        header.reserved = 0;
+        std::fwrite(&header, sizeof(header), 1, file);
+    }
+
+    ~Writer() {
+        // Fill in the record count.
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fclose(file);
+    }
+
+    void write(Addr addr, bool is_write, Tick tick, size_t gap = 0,
+               bool dep = false, int32_t core = -1) {
+        if ((addr & ((1ULL << header.addr_shift) - 1)) != 0)
+            PANIC("trace address is not aligned to the trace granularity");
+        char buf[MAX_RECORD];
+        char *p = buf + 1;
+        uint8_t tag = 0;
+        if (is_write)
+            tag |= WRITE;
+        if (dep)
+            tag |= DEP;
+        auto line = addr >> header.addr_shift;
+        p = put_varint(p, zigzag((int64_t)(line - last_addr)));
+        last_addr = line;
+        if (tick != last_tick) {
+            tag |= HAS_TICK;
+            p = put_varint(p, zigzag((int64_t)(tick - last_tick)));
+            last_tick = tick;
+        }
+        if (gap != 0) {
+            tag |= HAS_GAP;
+            p = put_varint(p, gap);
+        }
+        if (core >= 0) {
+            tag |= HAS_CORE;
+            p = put_varint(p, core);
+        }
+        buf[0] = (char)tag;
+        std::fwrite(buf, 1, p - buf, file);
+        header.count += 1;
+    }
+};
+} // namespace trace_format
+} // namespace xerxes
+
+#endif // XERXES_TRACE_FORMAT_HH
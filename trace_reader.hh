@@ -0,0 +1,349 @@
+#pragma once
+#ifndef XERXES_TRACE_READER_HH
+#define XERXES_TRACE_READER_HH
+
+#include "def.hh"
+#include "trace_format.hh"
+#include "trace_stream.hh"
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace xerxes {
+// Reads a trace, either a text one with one request per line:
+//   <hex addr> <type> <tick> [<gap> [<dependency flag> [<core id>]]]
+// or a binary one (see trace_format.hh), optionally gzip or zstd compressed.
+// The file is mapped into memory and decoded without allocations. Text is
+// decoded by a helper thread, which fills a single-producer single-consumer
+// ring of records ahead of the simulation. Binary records are cheaper to
+// decode than to hand over, so they are decoded in place, unless they need
+// decompression. Compressed traces are decompressed block by block by the
+// helper thread, and never as a whole.
+class TraceReader {
+  public:
+    struct Record {
+        Addr addr = 0;
+        bool is_write = false;
+        Tick tick = 0;
+        size_t gap = 0;
+        bool dep = false;
+        // Core issuing the request, -1 for any.
+        int32_t core = -1;
+    };
+
+  private:
+    static constexpr size_t RING_SIZE = 1 << 14;
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    const char *data = nullptr;
+    size_t size = 0;
+
+    // Decompressor of a compressed trace, and its current block of
+    // decompressed data, where [pos, block end) is not decoded yet.
+    TraceStream *stream = nullptr;
+    std::vector<char> block;
+    bool stream_end = false;
+
+    // Binary trace state.
+    bool binary = false;
+    bool in_place = false;
+    const char *pos = nullptr;
+    uint32_t addr_shift = 0;
+    uint64_t remaining = 0;
+    Addr last_addr = 0;
+    Tick last_tick = 0;
+
+    std::vector<Record> ring;
+    // Records [tail, head) are decoded and not consumed yet.
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::atomic<bool> done{false};
+    std::atomic<bool> stop{false};
+    std::thread worker;
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static bool is_write_type(const char *p, size_t n) {
+        auto is = [p, n](const char *s) {
+            return n == std::strlen(s) && std::memcmp(p, s, n) == 0;
+        };
+        return is("W") || is("WR") || is("WRITE") || is("write") ||
+               is("P_MEM_WR") || is("BOFF");
+    }
+
+    static uint64_t parse_hex(const char *&p, const char *end) {
+        if (end - p > 1 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+            p += 2;
+        uint64_t v = 0;
+        for (; p < end; ++p) {
+            auto c = *p;
+            if (c >= '0' && c <= '9')
+                v = v * 16 + (c - '0');
+            else if (c >= 'a' && c <= 'f')
+                v = v * 16 + (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                v = v * 16 + (c - 'A' + 10);
+            else
+                break;
+        }
+        return v;
+    }
+
+    static uint64_t parse_dec(const char *&p, const char *end) {
+        uint64_t v = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p)
+            v = v * 10 + (*p - '0');
+        return v;
+    }
+
+    // Decode one line of [p, end). Returns false for a blank line.
+    static bool parse_line(const char *p, const char *end, Record &rec) {
+        while (p < end && is_space(*p))
+            ++p;
+        if (p == end)
+            return false;
+        rec = Record{};
+        rec.addr = parse_hex(p, end);
+        while (p < end && is_space(*p))
+            ++p;
+        auto type = p;
+        while (p < end && !is_space(*p))
+            ++p;
+        rec.is_write = is_write_type(type, p - type);
+        uint64_t fields[4] = {0, 0, 0, 0};
+        size_t n = 0;
+        for (; n < 4; ++n) {
+            while (p < end && is_space(*p))
+                ++p;
+            if (p == end)
+                break;
+            fields[n] = parse_dec(p, end);
+        }
+        rec.tick = fields[0];
+        rec.gap = fields[1];
+        rec.dep = fields[2] != 0;
+        rec.core = n == 4 ? (int32_t)fields[3] : -1;
+        return true;
+    }
+
+    void decode(const char *&p, Record &rec) {
+        using namespace trace_format;
+        auto tag = (uint8_t)*p++;
+        rec.is_write = tag & WRITE;
+        rec.dep = tag & DEP;
+        last_addr += unzigzag(get_varint(p));
+        rec.addr = last_addr << addr_shift;
+        if (tag & HAS_TICK)
+            last_tick += unzigzag(get_varint(p));
+        rec.tick = last_tick;
+        rec.gap = (tag & HAS_GAP) ? get_varint(p) : 0;
+        rec.core = (tag & HAS_CORE) ? (int32_t)get_varint(p) : -1;
+    }
+
+    // Decode a record of [p, end), where end is the end of the data.
+    void decode_binary(const char *&p, const char *end, Record &rec) {
+        if ((size_t)(end - p) >= trace_format::MAX_RECORD) {
+            decode(p, rec);
+            return;
+        }
+        // Near the end of the data, decode from a padded copy so that a
+        // corrupted record cannot read past it.
+        if (p >= end)
+            PANIC("binary trace is truncated");
+        char buf[trace_format::MAX_RECORD] = {};
+        std::memcpy(buf, p, end - p);
+        const char *q = buf;
+        decode(q, rec);
+        if (q - buf > end - p)
+            PANIC("binary trace is truncated");
+        p += q - buf;
+    }
+
+    // Decide the format from the first bytes, and skip the binary header.
+    void start(const char *&p, const char *end, const std::string &format,
+               const std::string &path) {
+        if (format == "auto")
+            binary = trace_format::is_binary(p, end - p);
+        else if (format == "binary")
+            binary = true;
+        else
+            ASSERT(format == "text", "Unknown trace format: " + format);
+        if (!binary)
+            return;
+        ASSERT(trace_format::is_binary(p, end - p),
+               "Not a binary trace file " + path);
+        trace_format::Header header;
+        std::memcpy(&header, p, sizeof(header));
+        ASSERT(header.version == trace_format::VERSION,
+               "Unsupported binary trace version in " + path);
+        addr_shift = header.addr_shift;
+        remaining = header.count;
+        p += sizeof(header);
+    }
+
+    // Hand a record to the consumer, false if the reader is closing.
+    bool push(const Record &rec) {
+        auto h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) == RING_SIZE) {
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+            std::this_thread::yield();
+        }
+        ring[h % RING_SIZE] = rec;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Decode the text lines of [p, end), up to the last complete line
+    // unless `last` is set. Returns false if the reader is closing.
+    bool produce_text(const char *&p, const char *end, bool last) {
+        Record rec;
+        while (p < end && !stop.load(std::memory_order_relaxed)) {
+            auto eol = (const char *)std::memchr(p, '\n', end - p);
+            if (eol == nullptr) {
+                if (!last)
+                    return true;
+                eol = end;
+            }
+            if (parse_line(p, eol, rec) && !push(rec))
+                return false;
+            p = eol < end ? eol + 1 : end;
+        }
+        return !stop.load(std::memory_order_relaxed);
+    }
+
+    // Decode the binary records of [p, end), leaving a possibly partial
+    // record at the end unless `last` is set.
+    bool produce_binary(const char *&p, const char *end, bool last) {
+        Record rec;
+        while (remaining > 0 && (last || (size_t)(end - p) >=
+                                              trace_format::MAX_RECORD)) {
+            decode_binary(p, end, rec);
+            remaining -= 1;
+            if (!push(rec))
+                return false;
+        }
+        return true;
+    }
+
+    // Read the next block of a compressed trace, keeping the data after
+    // pos. Returns false at the end of the stream.
+    bool refill() {
+        if (stream_end)
+            return false;
+        auto left = block.data() + block.size() - pos;
+        std::memmove(block.data(), pos, left);
+        block.resize(BLOCK_SIZE);
+        if (left == (ssize_t)BLOCK_SIZE)
+            PANIC("trace line is longer than the decompression block");
+        auto n = stream->read(block.data() + left, BLOCK_SIZE - left);
+        block.resize(left + n);
+        pos = block.data();
+        stream_end = n == 0;
+        return !stream_end;
+    }
+
+    void produce() {
+        if (stream == nullptr) {
+            produce_text(pos, data + size, true);
+            done.store(true, std::memory_order_release);
+            return;
+        }
+        bool more = true;
+        while (more) {
+            auto end = block.data() + block.size();
+            more = !stream_end;
+            auto ok = binary ? produce_binary(pos, end, !more)
+                             : produce_text(pos, end, !more);
+            if (!ok || (binary && remaining == 0))
+                break;
+            if (more)
+                refill();
+        }
+        done.store(true, std::memory_order_release);
+    }
+
+  public:
+    // Format is "text", "binary" or "auto" (detected from the header).
+    TraceReader(const std::string &path, const std::string &format = "auto") {
+        int fd = open(path.c_str(), O_RDONLY);
+        ASSERT(fd >= 0, "Cannot open trace file " + path);
+        struct stat st;
+        ASSERT(fstat(fd, &st) == 0, "Cannot stat trace file " + path);
+        size = st.st_size;
+        if (size > 0) {
+            auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ASSERT(addr != MAP_FAILED, "Cannot map trace file " + path);
+            madvise(addr, size, MADV_SEQUENTIAL);
+            data = (const char *)addr;
+        }
+        close(fd);
+        stream = TraceStream::open(data, size, path);
+        if (stream != nullptr) {
+            // The first block decides the format.
+            pos = block.data();
+            refill();
+            start(pos, block.data() + block.size(), format, path);
+        } else {
+            pos = data;
+            start(pos, data + size, format, path);
+            in_place = binary;
+            if (in_place)
+                return;
+        }
+        ring.resize(RING_SIZE);
+        worker = std::thread([this]() { produce(); });
+    }
+
+    ~TraceReader() {
+        if (worker.joinable()) {
+            stop.store(true);
+            worker.join();
+        }
+        delete stream;
+        if (data != nullptr)
+            munmap((void *)data, size);
+    }
+
+    bool is_binary() { return binary; }
+
+    // True once every record is consumed. Waits for the helper thread if
+    // the ring is empty.
+    bool eof() {
+        if (in_place)
+            return remaining == 0;
+        auto t = tail.load(std::memory_order_relaxed);
+        while (head.load(std::memory_order_acquire) == t) {
+            if (done.load(std::memory_order_acquire))
+                return head.load(std::memory_order_acquire) == t;
+            std::this_thread::yield();
+        }
+        return false;
+    }
+
+    // Take the next record, false at the end of the trace.
+    bool next(Record &rec) {
+        if (eof())
+            return false;
+        if (in_place) {
+            decode_binary(pos, data + size, rec);
+            remaining -= 1;
+            return true;
+        }
+        auto t = tail.load(std::memory_order_relaxed);
+        rec = ring[t % RING_SIZE];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+};
+} // namespace xerxes
+
+#endif // XERXES_TRACE_READER_HH
@@ -0,0 +1,140 @@
+#pragma once
+#ifndef XERXES_TRACE_STREAM_HH
+#define XERXES_TRACE_STREAM_HH
+
+#include "def.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#ifdef XERXES_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef XERXES_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace xerxes {
+// Streaming decompression of a compressed trace held in memory (e.g., a
+// mapped file). The decompressed bytes only ever live in the caller's
+// buffer, block by block.
+class TraceStream {
+  public:
+    virtual ~TraceStream() {}
+    // Decompress up to n bytes into buf. Returns 0 at the end of the stream.
+    virtual size_t read(char *buf, size_t n) = 0;
+
+    // Open a decompressor by the magic bytes of data, or return nullptr if
+    // data is not compressed.
+    static TraceStream *open(const char *data, size_t size,
+                             const std::string &path);
+};
+
+#ifdef XERXES_HAVE_ZLIB
+class GzipStream : public TraceStream {
+    z_stream zs;
+    // Input not handed to zlib yet, avail_in is 32-bit so huge inputs are
+    // fed in slices.
+    size_t remaining;
+    bool ended = false;
+
+    void feed() {
+        if (zs.avail_in > 0 || remaining == 0)
+            return;
+        zs.avail_in = (uInt)std::min<size_t>(remaining, 1 << 30);
+        remaining -= zs.avail_in;
+    }
+
+  public:
+    GzipStream(const char *data, size_t size) : remaining(size) {
+        std::memset(&zs, 0, sizeof(zs));
+        // 15 + 32: the largest window, and detect gzip or zlib headers.
+        ASSERT(inflateInit2(&zs, 15 + 32) == Z_OK, "inflateInit2 failed");
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = 0;
+    }
+    ~GzipStream() { inflateEnd(&zs); }
+
+    size_t read(char *buf, size_t n) override {
+        zs.next_out = (Bytef *)buf;
+        zs.avail_out = n;
+        while (zs.avail_out > 0 && !ended) {
+            feed();
+            auto ret = inflate(&zs, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) {
+                // Concatenated members, as written by e.g. pigz.
+                feed();
+                if (zs.avail_in == 0)
+                    ended = true;
+                else
+                    inflateReset(&zs);
+            } else if (ret == Z_BUF_ERROR && zs.avail_in == 0) {
+                PANIC("gzip trace is truncated");
+            } else if (ret != Z_OK) {
+                PANIC(std::string("gzip trace is corrupted: ") +
+                      (zs.msg ? zs.msg : ""));
+            }
+        }
+        return n - zs.avail_out;
+    }
+};
+#endif
+
+#ifdef XERXES_HAVE_ZSTD
+class ZstdStream : public TraceStream {
+    ZSTD_DStream *zs;
+    ZSTD_inBuffer in;
+    // Result of the last ZSTD_decompressStream, 0 once a frame is complete.
+    size_t last = 1;
+
+  public:
+    ZstdStream(const char *data, size_t size) : in{data, size, 0} {
+        zs = ZSTD_createDStream();
+        ASSERT(zs != nullptr, "ZSTD_createDStream failed");
+        ZSTD_initDStream(zs);
+    }
+    ~ZstdStream() { ZSTD_freeDStream(zs); }
+
+    size_t read(char *buf, size_t n) override {
+        ZSTD_outBuffer out{buf, n, 0};
+        while (out.pos < out.size) {
+            // All frames are complete.
+            if (in.pos == in.size && last == 0)
+                break;
+            auto before = out.pos;
+            last = ZSTD_decompressStream(zs, &out, &in);
+            if (ZSTD_isError(last))
+                PANIC(std::string("zstd trace is corrupted: ") +
+                      ZSTD_getErrorName(last));
+            if (in.pos == in.size && out.pos == before && last != 0)
+                PANIC("zstd trace is truncated");
+        }
+        return out.pos;
+    }
+};
+#endif
+
+inline TraceStream *TraceStream::open(const char *data, size_t size,
+                                      const std::string &path) {
+    static const unsigned char GZIP[] = {0x1f, 0x8b};
+    static const unsigned char ZSTD[] = {0x28, 0xb5, 0x2f, 0xfd};
+    if (size >= 2 && std::memcmp(data, GZIP, 2) == 0) {
+#ifdef XERXES_HAVE_ZLIB
+        return new GzipStream(data, size);
+#else
+        PANIC("Xerxes is built without zlib, cannot read " + path);
+#endif
+    }
+    if (size >= 4 && std::memcmp(data, ZSTD, 4) == 0) {
+#ifdef XERXES_HAVE_ZSTD
+        return new ZstdStream(data, size);
+#else
+        PANIC("Xerxes is built without zstd, cannot read " + path);
+#endif
+    }
+    return nullptr;
+}
+} // namespace xerxes
+
+#endif // XERXES_TRACE_STREAM_HH
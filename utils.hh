@@ -73,6 +73,15 @@ class XerxesLogger {
     static XerxesLogger &error() { return get_or_set() << ERROR; }
 };
 
+// Debug logging on hot paths. Compiled out in release (NDEBUG) builds, so
+// that no formatting work is done per packet.
+#ifndef DEBUG_LOG
+#ifndef NDEBUG
+#define DEBUG_LOG(x) (XerxesLogger::debug() << x)
+#else
+#define DEBUG_LOG(x) ((void)0)
+#endif
+#endif
 #ifndef PANIC
 #define PANIC(msg) __panic((msg), __FILE__, __LINE__)
 #endif
@@ -1,5 +1,6 @@
 #include "xerxes_standalone.hh"
 #include "bus.hh"
+#include "analytical_memory.hh"
 #include "def.hh"
 #include "device.hh"
 #include "dramsim3_interface.hh"
@@ -21,7 +22,7 @@ void default_logger(const Packet &pkt) {
         first = false;
         XerxesLogger::info()
             << "id,type,memid,addr,send,arrive,bus_queuing,bus_time,"
-               "switch_queuing,switch_time,snoop_evict,host_inv,"
+               "link_retry,switch_queuing,switch_time,snoop_evict,host_inv,"
                "dram_queuing,dram_time,total_time"
             << std::endl;
     }
@@ -30,6 +31,8 @@ void default_logger(const Packet &pkt) {
                          << "," << pkt.sent << "," << pkt.arrive << ","
                          << pkt.get_stat(NormalStatType::BUS_QUEUE_DELAY) << ","
                          << pkt.get_stat(NormalStatType::BUS_TIME) << ","
+                         << pkt.get_stat(NormalStatType::LINK_RETRY_DELAY)
+                         << ","
                          << pkt.get_stat(NormalStatType::SWITCH_QUEUE_DELAY)
                          << "," << pkt.get_stat(NormalStatType::SWITCH_TIME)
                          << ","
@@ -79,8 +82,15 @@ class EventEngine {
     bool empty() { return events.empty(); }
 } glb_engine;
 
-void Device::sched_transit(Tick tick) {
-    glb_engine.add(tick, [this]() { this->transit(); });
+void Device::sched_transit(Tick tick, size_t count) {
+    if (count == 1) {
+        glb_engine.add(tick, [this]() { this->transit(); });
+        return;
+    }
+    glb_engine.add(tick, [this, count]() {
+        for (size_t i = 0; i < count; ++i)
+            this->transit();
+    });
 }
 
 void xerxes_schedule(EventFunc f, uint64_t tick) { glb_engine.add(tick, f); }
@@ -103,6 +113,8 @@ bool events_empty() { return glb_engine.empty(); }
             ctx.requesters.push_back(dynamic_cast<Requester *>(dev));          \
         else if (type == "DRAMsim3Interface")                                  \
             ctx.mems.push_back(dynamic_cast<DRAMsim3Interface *>(dev));        \
+        if (auto mem = dynamic_cast<MemoryEndpoint *>(dev))                    \
+            ctx.memories.push_back(mem);                                       \
         auto id = dev->id();                                                   \
         ctx.name_to_id[pair.first] = id;                                       \
         XerxesLogger::debug()                                                  \
@@ -115,6 +127,7 @@ XerxesContext parse_config(std::string config_file_name) {
     XerxesContext ctx;
     auto data = toml::parse(config_file_name);
     ctx.general = toml::get<XerxesConfig>(data);
+    ctx.general.threads = toml::find_or<int>(data, "threads", 1);
     for (auto &pair : ctx.general.devices) {
         auto type = pair.second;
         if (type == "SthUknown") {
@@ -124,6 +137,7 @@ XerxesContext parse_config(std::string config_file_name) {
         BUILD_DEVICE(Switch, SwitchConfig)
         BUILD_DEVICE(DuplexBus, DuplexBusConfig)
         BUILD_DEVICE(DRAMsim3Interface, DRAMsim3InterfaceConfig)
+        BUILD_DEVICE(AnalyticalMemory, AnalyticalMemoryConfig)
         BUILD_DEVICE(Snoop, SnoopConfig)
         else {
             PANIC("Unknown device type: " + type);
@@ -137,13 +151,45 @@ XerxesContext parse_config(std::string config_file_name) {
     // Call build route after all devices are added.
     glb_sim->topology()->build_route();
 
-    // Manually add end points for requesters.
-    // TODO: should decouple memory space and requesters.
+    // Map the memory space of requesters: by their HDM decoders, or else
+    // each memory in turn.
+    auto find_mem = [&ctx](const std::string &name) {
+        ASSERT(ctx.name_to_id.count(name), "Unknown HDM target: " + name);
+        auto id = ctx.name_to_id[name];
+        for (auto &mem : ctx.memories)
+            if (mem->id() == id)
+                return mem;
+        PANIC("HDM target " + name + " is not a memory");
+        return (MemoryEndpoint *)nullptr;
+    };
     for (auto &req : ctx.requesters) {
-        for (auto &mem : ctx.mems) {
-            req->add_end_point(mem->id(), mem->start_addr(), mem->capacity(),
-                               mem->wr_ratio());
+        if (req->decoders().empty()) {
+            for (auto &mem : ctx.memories) {
+                req->add_end_point(mem->id(), mem->start_addr(),
+                                   mem->capacity(), mem->wr_ratio());
+            }
+            continue;
+        }
+        AddressMap map;
+        double ratio = 0;
+        size_t ways = 0;
+        for (auto &config : req->decoders()) {
+            std::vector<MemoryEndpoint *> mems;
+            std::vector<TopoID> targets;
+            for (auto &name : config.targets) {
+                mems.push_back(find_mem(name));
+                targets.push_back(mems.back()->id());
+            }
+            HDMDecoder decoder(config, targets);
+            for (auto mem : mems) {
+                mem->add_decoder(decoder);
+                ratio += mem->wr_ratio();
+                ways += 1;
+            }
+            map.add(decoder);
         }
+        // The write ratio is averaged over the targets.
+        req->set_address_map(map, ratio / ways);
     }
     return ctx;
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include "analytical_memory.hh"
 #include "dramsim3_interface.hh"
 #include "requester.hh"
 #ifndef XERXES_STANDALONE_HH
@@ -16,6 +17,9 @@ struct XerxesConfig {
     Tick max_clock = 1000000;
     // Clock granularity (for DRAMsim3).
     int clock_granu = 10;
+    // Threads clocking the DRAMsim3 endpoints, 0 for one per hardware
+    // thread. Optional, so it is not part of the TOML conversion below.
+    int threads = 1;
     // Log level.
     std::string log_level = "INFO";
     // Log file name.
@@ -28,6 +32,7 @@ struct XerxesConfig {
 
 class Requester;
 class DRAMsim3Interface;
+class MemoryEndpoint;
 
 // Structured data from a TOML configuration file.
 struct XerxesContext {
@@ -37,8 +42,10 @@ struct XerxesContext {
     std::map<std::string, TopoID> name_to_id;
     // All requesters.
     std::vector<Requester *> requesters;
-    // All DRAMsim3 endpoints.
+    // All DRAMsim3 endpoints, which are clocked by the main loop.
     std::vector<DRAMsim3Interface *> mems;
+    // All memory endpoints, of any backend.
+    std::vector<MemoryEndpoint *> memories;
 };
 
 // Used for logging packet information, if the logger is not set by the user.